@@ -0,0 +1,11 @@
+#version 460 core
+
+out vec4 FragColor;
+in vec2 TexCoords;
+
+// the newest frame, blended into the history with a constant alpha of 1 / (n + 1)
+uniform sampler2D frameTex;
+
+void main() {
+    FragColor = vec4(texture(frameTex, TexCoords).rgb, 1.0);
+}
@@ -0,0 +1,12 @@
+// direction through the centre of a texel of a cubemap face, following the gl face layout
+vec3 texel_direction(int face, ivec2 texel, int size) {
+    vec2 st = (vec2(texel) + 0.5) / float(size) * 2.0 - 1.0;
+    switch (face) {
+        case 0: return vec3(1.0, -st.y, -st.x);
+        case 1: return vec3(-1.0, -st.y, st.x);
+        case 2: return vec3(st.x, 1.0, st.y);
+        case 3: return vec3(st.x, -1.0, -st.y);
+        case 4: return vec3(st.x, -st.y, 1.0);
+        default: return vec3(-st.x, -st.y, -1.0);
+    }
+}
@@ -0,0 +1,54 @@
+// detail normal maps, either sampled triplanar (three planar projections blended by the normal) or fetched
+// once by direction from the cubemap detail.comp projected them into
+
+// only x and y are stored (two channel compressed), z is the rest of a unit vector
+vec3 get_normal_from_texture(sampler2D map, vec2 uv, float lod) {
+    vec2 xy = (lod < 0.0 ? texture(map, uv).rg : textureLod(map, uv, lod).rg) * 2.0 - 1.0;
+    return vec3(xy, sqrt(max(0.0, 1.0 - dot(xy, xy))));
+}
+
+vec3 rnm(vec3 a, vec3 b) {
+    a += vec3(0.0, 0.0, 1.0);
+    b *= vec3(-1.0, -1.0, 1.0);
+    return a * dot(a, b) / a.z - b;
+}
+
+// the normal map applied around nn at pos, uv scrolled by offsets, and at a fixed mip level unless lod < 0
+vec3 triplanar_normal(sampler2D map, vec3 nn, vec3 pos, vec2 offsets, float lod) {
+    vec3 blend = abs(nn);
+    blend = max(blend - 0.2, 0.0);
+    blend /= dot(blend, vec3(1.0));
+
+    vec2 uvx = pos.zy + offsets;
+    vec2 uvy = pos.xz + offsets;
+    vec2 uvz = pos.xy + offsets;
+
+    vec3 tnx = get_normal_from_texture(map, uvx, lod);
+    vec3 tny = get_normal_from_texture(map, uvy, lod);
+    vec3 tnz = get_normal_from_texture(map, uvz, lod);
+
+    vec3 avn = abs(nn);
+    tnx = rnm(vec3(nn.zy, avn.x), tnx);
+    tny = rnm(vec3(nn.xz, avn.y), tny);
+    tnz = rnm(vec3(nn.xy, avn.z), tnz);
+
+    vec3 asign = sign(nn);
+    tnx.z *= asign.x;
+    tny.z *= asign.y;
+    tnz.z *= asign.z;
+
+    return normalize(tnx * blend.x + tny * blend.y + tnz * blend.z + nn);
+}
+
+// v turned by the shortest rotation taking the unit vector from onto the unit vector to
+vec3 reorient(vec3 v, vec3 from, vec3 to) {
+    vec3 k = cross(from, to);
+    float c = dot(from, to);
+    return v * c + cross(k, v) + k * (dot(k, v) / (1.0 + c));
+}
+
+// the cubemap holds the detail normal of each direction as if the surface there faced straight out,
+// so it is turned from the sphere's normal onto the actual one
+vec3 cubemap_normal(samplerCube map, vec3 dir, vec3 nn) {
+    return normalize(reorient(normalize(texture(map, dir).xyz), dir, nn));
+}
@@ -0,0 +1,31 @@
+#version 460 core
+
+#define ENABLE_OCEAN
+#include "postprocess.glsl"
+#include "froxel.glsl"
+
+out vec4 FragColour;
+
+in vec2 TexCoords; // (0, 0) is btm-left
+
+uniform sampler2D screenTex;
+uniform sampler2D depthTex;
+uniform sampler3D froxelTex;
+
+void main() {
+    vec4 colour = texture(screenTex, TexCoords);
+
+    vec3 view_vector = get_view_vector(TexCoords);
+    vec3 cam_dir = normalize(view_vector);
+    float scene_depth = linear_depth(texture(depthTex, TexCoords).r) * length(view_vector);
+
+    float surface_dst = shade_ocean(cam_dir, scene_depth, colour);
+
+    // each slice holds the scattering up to its far end, so fade in across the first one
+    float slices = float(textureSize(froxelTex, 0).z);
+    float w = froxel_slice(max(surface_dst, froxel_range.x)) * slices;
+    vec4 scatter = texture(froxelTex, vec3(TexCoords, (w - 0.5) / slices));
+    scatter = mix(vec4(0.0, 0.0, 0.0, 1.0), scatter, clamp(w, 0.0, 1.0));
+
+    FragColour = vec4(vec3(colour) * scatter.a + scatter.rgb, 1.0);
+}
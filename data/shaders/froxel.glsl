@@ -0,0 +1,13 @@
+// shared by the froxel passes, include after postprocess.glsl
+
+uniform vec2 froxel_range; // view distance covered by the volume, start (x) end (y)
+
+// view distance at slice coordinate s in [0, 1], slices are spaced exponentially
+float froxel_distance(float s) {
+    return froxel_range.x * pow(froxel_range.y / froxel_range.x, s);
+}
+
+// inverse of froxel_distance
+float froxel_slice(float d) {
+    return log(d / froxel_range.x) / log(froxel_range.y / froxel_range.x);
+}
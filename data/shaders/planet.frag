@@ -1,5 +1,8 @@
 #version 460 core
 
+#include "virtual_terrain.glsl"
+#include "detail.glsl"
+
 in float localHt;
 in vec3 position;
 in vec3 localUp;
@@ -35,25 +38,38 @@ uniform float spec_str;
 
 uniform sampler2D terrain_normal_map;
 
-const float pi = 3.141592654;
+// or the normal map projected onto the terrain by detail.comp, a single fetch by direction
+uniform bool cubemap_detail;
+uniform samplerCube terrain_detail_map;
 
-float saturate(float x) {
-    return min(1.0, max(0.0, x));
-}
+// the baked terrain from planet.vert, sampled again per pixel for detail finer than the mesh
+uniform bool baked_terrain;
+uniform samplerCube terrain_map;
+
+const float pi = 3.141592654;
 
-vec3 get_normal_from_texture(vec2 uv) {
-    vec3 rgb = texture(terrain_normal_map, uv).rgb;
-    return normalize(rgb * 2.0 - 1.0);
+// deepest tile level whose texels are no smaller than a pixel, from how far the direction turns per pixel
+// (near the middle of a face uv moves half as fast as the angle, so level l has VT_TILE_SIZE * 2^l / 2 texels per radian)
+int vt_level(vec3 dir) {
+    vec3 d = normalize(dir);
+    float turn = max(length(dFdx(d)), length(dFdy(d)));
+    return int(clamp(floor(log2(2.0 / (VT_TILE_SIZE * max(turn, 1e-9)))), 0.0, float(vt_max_level)));
 }
 
-vec3 rnm(vec3 a, vec3 b) {
-    a += vec3(0, 0, 1);
-    b *= vec3(-1, -1, 1);
-    return a * dot(a, b) / a.z - b;
+float saturate(float x) {
+    return min(1.0, max(0.0, x));
 }
 
 void main() {
-    float steepness = 1.0 - dot(normal, localUp);
+    vec3 surface_normal = normal;
+    float surface_ht = localHt;
+    if (virtual_terrain || baked_terrain) {
+        vec4 terrain = virtual_terrain ? vt_sample(localUp, vt_level(localUp)) : texture(terrain_map, localUp);
+        surface_normal = normalize(terrain.xyz);
+        surface_ht = terrain.w;
+    }
+
+    float steepness = 1.0 - dot(surface_normal, localUp);
     // steepness = min(1.0, max(0.0, steepness / 0.6));
 
     float slope_threshold = colour_params.x;
@@ -74,50 +90,27 @@ void main() {
 
     // grass only below a certain elevation
     float grass_blend_ht = grass_threshold * (1.0 - grass_blend);
-    float grass_weight = saturate((localHt - grass_blend_ht) / (grass_threshold - grass_blend_ht));
+    float grass_weight = saturate((surface_ht - grass_blend_ht) / (grass_threshold - grass_blend_ht));
     landCol = mix(landCol, rock_colour, grass_weight);
 
     // shore only below a certain elevation
     float shore_blend_ht = shore_threshold * (1.0 - shore_blend);
-    float shore_weight = saturate((localHt - shore_blend_ht) / (shore_threshold - shore_blend_ht));
+    float shore_weight = saturate((surface_ht - shore_blend_ht) / (shore_threshold - shore_blend_ht));
     landCol = mix(shore_colour, landCol, shore_weight);
  
     // seafloor when below 0
     float seafloor_blend_ht = seafloor_threshold * (1.0 - seafloor_blend);
-    float seafloor_weight = saturate((localHt - seafloor_blend_ht) / (seafloor_threshold - seafloor_blend_ht));
+    float seafloor_weight = saturate((surface_ht - seafloor_blend_ht) / (seafloor_threshold - seafloor_blend_ht));
     landCol = mix(seafloor_colour, landCol, seafloor_weight);
 
     // snow past a certain elevation
     float snow_blend_ht = snow_threshold * (1.0 - snow_blend);
-    float snow_weight = saturate((localHt - snow_blend_ht) / (snow_threshold - snow_blend_ht));
+    float snow_weight = saturate((surface_ht - snow_blend_ht) / (snow_threshold - snow_blend_ht));
     landCol = mix(landCol, snow_colour, snow_weight);
 
     // compute triplanar mapping and compute normal from normal map
-    vec3 nn = normalize(tinv_mdl * normal);
-
-    vec3 blend = abs(nn);
-    blend = max(blend - 0.2, 0);
-    blend /= dot(blend, vec3(1.0));
-
-    vec2 uvx = position.zy;
-    vec2 uvy = position.xz;
-    vec2 uvz = position.xy;
-
-    vec3 tnx = get_normal_from_texture(uvx);
-    vec3 tny = get_normal_from_texture(uvy);
-    vec3 tnz = get_normal_from_texture(uvz);
-
-    vec3 avn = abs(nn);
-    tnx = rnm(vec3(nn.zy, avn.x), tnx);
-    tny = rnm(vec3(nn.xz, avn.y), tny);
-    tnz = rnm(vec3(nn.xy, avn.z), tnz);
-
-    vec3 asign = sign(nn);
-    tnx.z *= asign.x;
-    tny.z *= asign.y;
-    tnz.z *= asign.z;
-
-    vec3 norm = normalize(tnx * blend.x + tny * blend.y + tnz * blend.z + nn);
+    vec3 nn = normalize(tinv_mdl * surface_normal);
+    vec3 norm = cubemap_detail ? cubemap_normal(terrain_detail_map, normalize(localUp), nn) : triplanar_normal(terrain_normal_map, nn, position, vec2(0.0), -1.0);
     // norm = norm * 0.5 + 0.5;
 
     // compute spherical mapping (assignment 3)
@@ -0,0 +1,26 @@
+#version 460 core
+
+out vec4 FragColor;
+in vec2 TexCoords;
+
+uniform sampler2D srcTex;
+uniform float sharpness; // 0 (soft) to 1 (strongest)
+
+// bilinear upscale followed by contrast adaptive sharpening (after amd's fidelityfx cas)
+void main() {
+    vec2 texel = 1.0 / vec2(textureSize(srcTex, 0));
+    vec3 c = texture(srcTex, TexCoords).rgb;
+    vec3 n = texture(srcTex, TexCoords + vec2(0, texel.y)).rgb;
+    vec3 s = texture(srcTex, TexCoords - vec2(0, texel.y)).rgb;
+    vec3 e = texture(srcTex, TexCoords + vec2(texel.x, 0)).rgb;
+    vec3 w = texture(srcTex, TexCoords - vec2(texel.x, 0)).rgb;
+
+    // sharpen less where there is already a lot of local contrast, so edges do not ring
+    vec3 mn = min(c, min(min(n, s), min(e, w)));
+    vec3 mx = max(c, max(max(n, s), max(e, w)));
+    vec3 amp = sqrt(clamp(min(mn, 1.0 - mx) / max(mx, 1e-4), 0.0, 1.0));
+    vec3 weight = -amp * mix(0.125, 0.2, sharpness);
+
+    vec3 colour = (c + (n + s + e + w) * weight) / (1.0 + 4.0 * weight);
+    FragColor = vec4(clamp(colour, 0.0, 1.0), 1.0);
+}
@@ -0,0 +1,72 @@
+// shared by planet.vert and planet.frag, looks up the terrain tiles paged in by VirtualTerrain
+// the sizes and the page table hash match virtual_terrain.h
+
+const int VT_TILE_SIZE = 64;
+const int VT_TILE_BORDER = 1;
+const int VT_TILE_STRIDE = 66;
+const int VT_ATLAS_TILES = 16;
+const uint VT_PAGE_TABLE_SIZE = 1024u;
+
+// tile key (xy) and atlas slot (z), an empty entry has a key.y of all ones
+layout (std430, binding = 4) readonly buffer PageTable {
+    uvec4 pages[];
+};
+
+uniform bool virtual_terrain;
+uniform sampler2D vt_atlas;
+uniform int vt_max_level;
+
+// face (in gl cubemap order) and coordinates in [0, 1] of the face a direction points at
+int vt_face_uv(vec3 dir, out vec2 uv) {
+    vec3 a = abs(dir);
+    int face;
+    float major;
+    vec2 st;
+    if (a.x >= a.y && a.x >= a.z) {
+        face = dir.x > 0.0 ? 0 : 1;
+        major = a.x;
+        st = vec2(dir.x > 0.0 ? -dir.z : dir.z, -dir.y);
+    } else if (a.y >= a.z) {
+        face = dir.y > 0.0 ? 2 : 3;
+        major = a.y;
+        st = vec2(dir.x, dir.y > 0.0 ? dir.z : -dir.z);
+    } else {
+        face = dir.z > 0.0 ? 4 : 5;
+        major = a.z;
+        st = vec2(dir.z > 0.0 ? dir.x : -dir.x, -dir.y);
+    }
+    uv = (st / major + 1.0) * 0.5;
+    return face;
+}
+
+int vt_find(uvec2 key) {
+    uint h = (key.x * 0x9e3779b1u) ^ (key.y * 0x85ebca77u);
+    h ^= h >> 15;
+    for (uint i = 0u; i < VT_PAGE_TABLE_SIZE; i++) {
+        uvec4 page = pages[(h + i) & (VT_PAGE_TABLE_SIZE - 1u)];
+        if (page.y == 0xffffffffu) {
+            return -1;
+        }
+        if (page.xy == key) {
+            return int(page.z);
+        }
+    }
+    return -1;
+}
+
+// normal (xyz) and raw noise height (w) from the finest resident tile at or above level
+vec4 vt_sample(vec3 dir, int level) {
+    vec2 uv;
+    int face = vt_face_uv(dir, uv);
+    for (int l = min(level, vt_max_level); l >= 0; l--) {
+        float count = float(1 << l);
+        ivec2 tile = ivec2(min(floor(uv * count), vec2(count - 1.0)));
+        int slot = vt_find(uvec2(uint(tile.x) | (uint(tile.y) << 16), uint(face) | (uint(l) << 3)));
+        if (slot >= 0) {
+            vec2 local = uv * count - vec2(tile);
+            vec2 texel = vec2(slot % VT_ATLAS_TILES, slot / VT_ATLAS_TILES) * float(VT_TILE_STRIDE) + float(VT_TILE_BORDER) + local * float(VT_TILE_SIZE);
+            return textureLod(vt_atlas, texel / float(VT_ATLAS_TILES * VT_TILE_STRIDE), 0.0);
+        }
+    }
+    return vec4(normalize(dir), 0.0);
+}
@@ -0,0 +1,114 @@
+#include "alloc_tracker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "profiler.h"
+
+// none of this may allocate, it runs inside operator new
+static std::atomic<bool> counting{false};
+static std::atomic<int> frame_allocations{0}, other_allocations{0};
+static std::atomic<size_t> frame_bytes{0}, other_bytes{0};
+
+static thread_local const char *site = nullptr;
+static thread_local bool frame_thread = false;
+
+// only ever touched by the thread that ends the frames
+static AllocSite site_counts[ALLOC_SITES];
+static int num_site_counts = 0;
+
+static void record(size_t size) {
+    if (!counting.load(std::memory_order_relaxed)) {
+        return;
+    }
+    frame_allocations.fetch_add(1, std::memory_order_relaxed);
+    frame_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (!frame_thread) {
+        other_allocations.fetch_add(1, std::memory_order_relaxed);
+        other_bytes.fetch_add(size, std::memory_order_relaxed);
+        return;
+    }
+
+    const char *name = site ? site : "(outside scopes)";
+    for (int i = 0; i < num_site_counts; i++) {
+        if (site_counts[i].name == name) {
+            site_counts[i].count++;
+            site_counts[i].bytes += size;
+            return;
+        }
+    }
+    if (num_site_counts < ALLOC_SITES) {
+        site_counts[num_site_counts++] = {name, 1, size};
+    }
+}
+
+void *operator new(size_t size) {
+    record(size);
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+
+AllocTracker &AllocTracker::get() {
+    static AllocTracker tracker;
+    return tracker;
+}
+
+void AllocTracker::set_enabled(bool enabled) {
+    counting = enabled;
+}
+
+bool AllocTracker::is_enabled() {
+    return counting;
+}
+
+void AllocTracker::set_site(const char *name) {
+    site = name;
+}
+
+void AllocTracker::end_frame() {
+    frame_thread = true;
+    allocations = frame_allocations.exchange(0);
+    bytes = frame_bytes.exchange(0);
+
+    num_sites = 0;
+    for (int i = 0; i < num_site_counts && num_sites < ALLOC_SITES; i++) {
+        sites[num_sites++] = site_counts[i];
+    }
+    int others = other_allocations.exchange(0);
+    size_t other = other_bytes.exchange(0);
+    if (others > 0 && num_sites < ALLOC_SITES) {
+        sites[num_sites++] = {"(other threads)", others, other};
+    }
+    num_site_counts = 0;
+    std::sort(sites, sites + num_sites, [](const AllocSite &a, const AllocSite &b) { return a.count > b.count; });
+
+    if (counting) {
+        Profiler::get().count("heap allocations", (float)allocations);
+        Profiler::get().count("heap kb", bytes / 1024.0f);
+    }
+}
@@ -0,0 +1,360 @@
+#include "artifact_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "stb_image.h"
+
+// 24 bytes, so the payload of a mapped file stays 8-byte aligned
+struct ArtifactHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint64_t size;
+};
+
+Artifact::~Artifact() {
+    if (!mapping) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(mapping);
+    CloseHandle((HANDLE)mapping_handle);
+    CloseHandle((HANDLE)file_handle);
+#else
+    munmap(mapping, mapping_size);
+#endif
+}
+
+ArtifactCache &ArtifactCache::get() {
+    static ArtifactCache cache;
+    return cache;
+}
+
+std::shared_ptr<const Artifact> ArtifactCache::find(const CacheKey &key) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    CacheStats &kind = stats[key.kind];
+    if (!enabled) {
+        kind.misses++;
+        return nullptr;
+    }
+
+    auto entry = entries.find(key.hash);
+    if (entry != entries.end()) {
+        recent.splice(recent.begin(), recent, entry->second.position);
+        kind.memory_hits++;
+        return entry->second.artifact;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::string path = file_path(key.hash);
+    std::shared_ptr<Artifact> artifact = map_file(path, key.hash);
+    if (!artifact) {
+        kind.misses++;
+        return nullptr;
+    }
+    // the modification time doubles as the last use, for the disk cap
+    std::error_code error;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+    kind.disk_hits++;
+    kind.load_ms += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    remember(key.hash, artifact);
+    return artifact;
+}
+
+std::shared_ptr<const Artifact> ArtifactCache::store(const CacheKey &key, const std::vector<std::pair<const void *, size_t>> &parts) {
+    std::shared_ptr<Artifact> artifact = std::make_shared<Artifact>();
+    size_t size = 0;
+    for (const auto &part : parts) {
+        size += part.second;
+    }
+    artifact->owned.resize(size);
+    size_t offset = 0;
+    for (const auto &part : parts) {
+        memcpy(artifact->owned.data() + offset, part.first, part.second);
+        offset += part.second;
+    }
+    artifact->bytes = artifact->owned.data();
+    artifact->length = size;
+    artifact->tracked.set(size);
+
+    if (!enabled) {
+        return artifact;
+    }
+
+    // write to a temporary file of its own and move it into place, so a crash never leaves half an artifact
+    // behind; only the move takes the lock, finds on the gl thread never wait for a worker's disk writes
+    static std::atomic<unsigned int> temp_count{0};
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    std::string path = file_path(key.hash);
+    std::string temp_path = path + "." + std::to_string(temp_count++) + ".tmp";
+    ArtifactHeader header;
+    memcpy(header.magic, ARTIFACT_MAGIC, sizeof(header.magic));
+    header.version = ARTIFACT_VERSION;
+    header.key = key.hash;
+    header.size = size;
+    {
+        std::ofstream file(temp_path, std::ios::binary);
+        file.write((const char *)&header, sizeof(header));
+        file.write((const char *)artifact->bytes, size);
+        error = file ? std::error_code() : std::make_error_code(std::errc::io_error);
+    }
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+        if (!error) {
+            // an artifact stored again replaces its old file, which no longer counts
+            std::error_code missing;
+            uintmax_t replaced = std::filesystem::file_size(path, missing);
+            std::filesystem::rename(temp_path, path, error);
+            if (!error) {
+                disk_bytes += sizeof(header) + size - (missing ? 0 : (size_t)replaced);
+            }
+        }
+        remember(key.hash, artifact);
+    }
+    if (error) {
+        std::cout << "Failed to write artifact " << path << std::endl;
+        std::filesystem::remove(temp_path, error);
+    } else {
+        trim_disk(path);
+    }
+    return artifact;
+}
+
+std::shared_ptr<const Artifact> ArtifactCache::load_image(const std::string &path, int channels, int &width, int &height) {
+    // the file's size and modification time stand in for its contents
+    std::error_code error;
+    uintmax_t file_size = std::filesystem::file_size(path, error);
+    if (error) {
+        return nullptr;
+    }
+    long long modified = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+
+    CacheKey key("image");
+    key.add(path).add(file_size).add(modified).add(channels);
+    std::shared_ptr<const Artifact> image = find(key);
+    if (!image) {
+        int w, h, c;
+        unsigned char *data = stbi_load(path.c_str(), &w, &h, &c, channels);
+        if (!data) {
+            return nullptr;
+        }
+        int32_t header[3] = {w, h, channels};
+        image = store(key, {{header, sizeof(header)}, {data, (size_t)w * h * channels}});
+        stbi_image_free(data);
+    }
+
+    const int32_t *header = (const int32_t *)image->data();
+    width = header[0];
+    height = header[1];
+    return image;
+}
+
+const unsigned char *ArtifactCache::image_pixels(const Artifact &image) {
+    return image.data() + 3 * sizeof(int32_t);
+}
+
+void ArtifactCache::clear_memory() {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    entries.clear();
+    recent.clear();
+    used = 0;
+}
+
+void ArtifactCache::clear_disk() {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    std::lock_guard<std::mutex> disk_lock(disk_mutex);
+    clear_memory();
+    std::error_code error;
+    for (const auto &file : std::filesystem::directory_iterator(directory, error)) {
+        if (file.path().extension() == ".art") {
+            std::filesystem::remove(file.path(), error);
+        }
+    }
+    disk_bytes = 0;
+    disk_scanned = true;
+}
+
+size_t ArtifactCache::memory_used() {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    return used;
+}
+
+size_t ArtifactCache::disk_used() {
+    if (!disk_scanned) {
+        std::lock_guard<std::mutex> disk_lock(disk_mutex);
+        scan_disk();
+    }
+    return disk_bytes;
+}
+
+std::map<std::string, CacheStats> ArtifactCache::get_stats() {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    return stats;
+}
+
+std::string ArtifactCache::file_path(uint64_t hash) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.art", (unsigned long long)hash);
+    return (std::filesystem::path(directory) / name).string();
+}
+
+std::shared_ptr<Artifact> Artifact::map(const std::string &path, size_t min_size) {
+    std::shared_ptr<Artifact> artifact = std::make_shared<Artifact>();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file, &file_size);
+    HANDLE mapping = file_size.QuadPart >= (LONGLONG)min_size ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    void *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!view) {
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return nullptr;
+    }
+    artifact->file_handle = file;
+    artifact->mapping_handle = mapping;
+    artifact->mapping = view;
+    artifact->mapping_size = (size_t)file_size.QuadPart;
+#else
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return nullptr;
+    }
+    struct stat info;
+    void *view = MAP_FAILED;
+    if (fstat(file, &info) == 0 && info.st_size >= (off_t)min_size) {
+        view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    }
+    // the mapping keeps the file alive on its own
+    close(file);
+    if (view == MAP_FAILED) {
+        return nullptr;
+    }
+    artifact->mapping = view;
+    artifact->mapping_size = (size_t)info.st_size;
+#endif
+    artifact->bytes = (const unsigned char *)view;
+    artifact->length = artifact->mapping_size;
+    artifact->tracked.set(artifact->mapping_size);
+    return artifact;
+}
+
+// map an artifact file read-only, null if it is missing or does not hold the artifact for hash
+std::shared_ptr<Artifact> ArtifactCache::map_file(const std::string &path, uint64_t hash) {
+    std::shared_ptr<Artifact> artifact = Artifact::map(path, sizeof(ArtifactHeader));
+    if (!artifact) {
+        return nullptr;
+    }
+
+    const ArtifactHeader *header = (const ArtifactHeader *)artifact->mapping;
+    if (memcmp(header->magic, ARTIFACT_MAGIC, sizeof(header->magic)) != 0 || header->version != ARTIFACT_VERSION || header->key != hash ||
+        header->size != artifact->mapping_size - sizeof(ArtifactHeader)) {
+        std::cout << "Ignoring stale artifact " << path << std::endl;
+        return nullptr;
+    }
+    artifact->bytes = (const unsigned char *)artifact->mapping + sizeof(ArtifactHeader);
+    artifact->length = (size_t)header->size;
+    return artifact;
+}
+
+// total up the artifacts already on disk, the first time the total is needed (call with disk_mutex held)
+void ArtifactCache::scan_disk() {
+    if (disk_scanned) {
+        return;
+    }
+    size_t size = 0;
+    std::error_code error;
+    for (const auto &file : std::filesystem::directory_iterator(directory, error)) {
+        if (file.path().extension() == ".art") {
+            size += (size_t)file.file_size(error);
+        }
+    }
+    disk_bytes = size;
+    disk_scanned = true;
+}
+
+// once the running total passes the disk cap, delete the artifacts used longest ago until the directory fits
+// again, never keep (just written); a file still mapped stays readable until it is closed, and runs without
+// the cache lock (a file some other store already deleted is simply skipped)
+void ArtifactCache::trim_disk(const std::string &keep) {
+    if (disk_scanned && disk_bytes <= disk_cap) {
+        return;
+    }
+    std::lock_guard<std::mutex> disk_lock(disk_mutex);
+    scan_disk();
+    if (disk_bytes <= disk_cap) {
+        return;
+    }
+
+    // the directory is only listed when something has to go, which also corrects any drift in the total
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> files;
+    size_t size = 0;
+    std::error_code error;
+    for (const auto &file : std::filesystem::directory_iterator(directory, error)) {
+        if (file.path().extension() == ".art") {
+            size += (size_t)file.file_size(error);
+            files.push_back({file.last_write_time(error), file.path()});
+        }
+    }
+    std::sort(files.begin(), files.end());
+    for (const auto &file : files) {
+        if (size <= disk_cap) {
+            break;
+        }
+        if (file.second == std::filesystem::path(keep)) {
+            continue;
+        }
+        size_t file_size = (size_t)std::filesystem::file_size(file.second, error);
+        if (std::filesystem::remove(file.second, error)) {
+            size -= file_size;
+            disk_evictions++;
+        }
+    }
+    disk_bytes = size;
+}
+
+// keep an artifact open as the most recent one, closing the least recently used ones past the cap
+// (anything still held elsewhere stays alive until it is let go)
+void ArtifactCache::remember(uint64_t hash, std::shared_ptr<const Artifact> artifact) {
+    auto entry = entries.find(hash);
+    if (entry != entries.end()) {
+        used -= entry->second.artifact->size();
+        recent.erase(entry->second.position);
+        entries.erase(entry);
+    }
+    recent.push_front(hash);
+    entries[hash] = {artifact, recent.begin()};
+    used += artifact->size();
+
+    while (used > memory_cap && recent.size() > 1) {
+        auto last = entries.find(recent.back());
+        used -= last->second.artifact->size();
+        entries.erase(last);
+        recent.pop_back();
+        evictions++;
+    }
+}
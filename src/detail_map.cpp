@@ -0,0 +1,97 @@
+#include "detail_map.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "gl_state.h"
+#include "hash.h"
+#include "profiler.h"
+
+void DetailMap::update(unsigned int normal_map, const glm::mat4 &model, int resolution, const PlanetParams *terrain, float radius) {
+    uint64_t h = fnv1a(&normal_map, sizeof(normal_map));
+    h = fnv1a(&model, sizeof(model), h);
+    h = fnv1a(&resolution, sizeof(resolution), h);
+    if (terrain) {
+        h = fnv1a(&radius, sizeof(radius), h);
+        h = fnv1a(&terrain->noise_mult, sizeof(terrain->noise_mult), h);
+        h = fnv1a(&terrain->offset, sizeof(terrain->offset), h);
+        h = fnv1a(&terrain->octaves, sizeof(terrain->octaves), h);
+        h = fnv1a(&terrain->noise_params, sizeof(terrain->noise_params), h);
+        h = fnv1a(&terrain->ocean_params, sizeof(terrain->ocean_params), h);
+    }
+    if (h == baked_hash) {
+        return;
+    }
+    ProfileScope scope("detail bake", true);
+
+    if (!built) {
+        shader.build_compute("data/shaders/detail.comp");
+        built = true;
+    }
+    if (texture_resolution != resolution) {
+        texture = GlTexture::generate();
+        GlState::get().bind_texture(GL_TEXTURE_CUBE_MAP, texture);
+        glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1 + (int)std::log2(resolution), GL_RGBA8_SNORM, resolution, resolution);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        GlState::get().enable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+        texture_resolution = resolution;
+        tracked.set(get_size());
+    }
+
+    // prefilter the normal map down to about one of its texels per cubemap texel, which near the middle of a
+    // face are 2 / resolution of the sphere's radius apart
+    int map_width = 1;
+    GlState::get().bind_texture(GL_TEXTURE_2D, normal_map);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &map_width);
+    float world_radius = model[0][0] * (terrain ? radius : 1.0f);
+    float lod = std::max(0.0f, std::log2(map_width * 2.0f * world_radius / resolution));
+
+    shader.use();
+    shader.set_int("normal_map", 0);
+    shader.set_matrix4("model", model);
+    shader.set_float("lod", lod);
+    shader.set_bool("on_terrain", terrain != nullptr);
+    if (terrain) {
+        shader.set_float("radius", radius);
+        shader.set_float("noise_mult", terrain->noise_mult);
+        shader.set_vector3("offset", terrain->offset);
+        shader.set_int("octaves", terrain->octaves);
+        shader.set_vector4("noise_params", terrain->noise_params);
+        shader.set_vector3("ocean_params", terrain->ocean_params);
+    }
+    GlState::get().bind_texture(0, GL_TEXTURE_2D, normal_map);
+    glBindImageTexture(0, texture, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8_SNORM);
+
+    // in bands of rows like the terrain bake, so no single dispatch runs long enough to trip the watchdog
+    const int band = 512;
+    for (int face = 0; face < 6; face++) {
+        shader.set_int("face", face);
+        for (int row = 0; row < resolution; row += band) {
+            shader.set_int("first_row", row);
+            glDispatchCompute((resolution + 7) / 8, (std::min(band, resolution - row) + 7) / 8, 1);
+        }
+    }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+    GlState::get().bind_texture(GL_TEXTURE_CUBE_MAP, texture);
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    GlState::get().bind_texture(GL_TEXTURE_CUBE_MAP, 0);
+    baked_hash = h;
+}
+
+void DetailMap::release() {
+    texture.reset();
+    tracked.set(0);
+    texture_resolution = 0;
+    baked_hash = 0;
+}
+
+size_t DetailMap::get_size() {
+    // rgba8, a full mip chain adds a third
+    return (size_t)texture_resolution * texture_resolution * 6 * 4 * 4 / 3;
+}
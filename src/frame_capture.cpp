@@ -0,0 +1,195 @@
+#include "frame_capture.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#include "gl_state.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+FrameCapture::FrameCapture(int num_threads) : encoders(num_threads) {}
+
+void FrameCapture::screenshot(const std::string &path) {
+    pending_screenshot = path;
+}
+
+bool FrameCapture::start_sequence(const std::string &dir, float fps) {
+    std::error_code error;
+    std::filesystem::create_directories(dir, error);
+    if (error) {
+        status = "Failed to create " + dir;
+        std::cout << status << std::endl;
+        return false;
+    }
+    sequence_dir = dir;
+    this->fps = fps;
+    start_time = -1;
+    sequence_frame = 0;
+    sequencing = true;
+    status = "Writing to " + dir;
+    return true;
+}
+
+void FrameCapture::stop_sequence() {
+    if (sequencing) {
+        status = "Wrote " + std::to_string(sequence_frame) + " frames to " + sequence_dir;
+    }
+    sequencing = false;
+}
+
+float FrameCapture::frame_time(float time) {
+    if (!sequencing) {
+        return time;
+    }
+    if (start_time < 0) {
+        start_time = time;
+    }
+    return start_time + sequence_frame / fps;
+}
+
+void FrameCapture::capture(unsigned int fbo, int width, int height) {
+    // encode whatever has landed, oldest first
+    for (int i = 0; i < CAPTURE_FRAMES; i++) {
+        Slot &slot = slots[(next + i) % CAPTURE_FRAMES];
+        if (slot.fence) {
+            retire(slot, false);
+        }
+    }
+
+    std::string path = pending_screenshot;
+    if (sequencing) {
+        char name[32];
+        snprintf(name, sizeof(name), "frame_%05d.png", sequence_frame);
+        path = (std::filesystem::path(sequence_dir) / name).string();
+    }
+    if (path.empty()) {
+        return;
+    }
+    if (!pending_screenshot.empty()) {
+        status = "Saving " + pending_screenshot;
+    }
+    pending_screenshot.clear();
+
+    // every buffer is in flight, frames are never dropped so wait for the oldest one
+    Slot &slot = slots[next];
+    if (slot.fence) {
+        stalls++;
+        retire(slot, true);
+    }
+    next = (next + 1) % CAPTURE_FRAMES;
+
+    size_t size = (size_t)width * height * 3;
+    if (!slot.pbo) {
+        slot.pbo = GlBuffer::generate();
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    if (slot.size != size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        slot.size = size;
+        slot.tracked.set(size);
+    }
+    slot.width = width;
+    slot.height = height;
+    slot.path = path;
+
+    // the read only queues a copy into the buffer, the fence says when it is done
+    GlState::get().bind_framebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glReadBuffer(fbo ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    GlState::get().bind_framebuffer(GL_READ_FRAMEBUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    if (sequencing) {
+        sequence_frame++;
+        status = "Writing to " + sequence_dir + ", frame " + std::to_string(sequence_frame);
+    }
+    if (failed > 0) {
+        status = std::to_string(failed) + " frames could not be written";
+    }
+}
+
+// copy a finished read out of its buffer and queue it for encoding, without waiting unless asked to
+void FrameCapture::retire(Slot &slot, bool wait) {
+    GLenum result = glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000ull : 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        if (!wait) {
+            return;
+        }
+        // a second has passed, the read is as good as lost
+        glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, ~0ull);
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+
+    std::vector<unsigned char> pixels(slot.size);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+    if (data) {
+        memcpy(pixels.data(), data, slot.size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!data) {
+        std::cout << "Failed to map the capture of " << slot.path << std::endl;
+        failed++;
+        return;
+    }
+
+    // at most two frames per encoder wait in memory, past that the encoders hold up the frame
+    encoders.wait(encoders.size() * 2);
+    int width = slot.width, height = slot.height;
+    encoders.submit([this, path = slot.path, width, height, pixels = std::move(pixels)] {
+        auto start = std::chrono::steady_clock::now();
+        // gl rows are bottom first, so write them from the last row up
+        int stride = width * 3;
+        if (stbi_write_png(path.c_str(), width, height, 3, pixels.data() + (size_t)stride * (height - 1), -stride)) {
+            written++;
+        } else {
+            std::cout << "Failed to write " << path << std::endl;
+            failed++;
+        }
+        encode_us += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    });
+}
+
+void FrameCapture::flush() {
+    for (int i = 0; i < CAPTURE_FRAMES; i++) {
+        Slot &slot = slots[(next + i) % CAPTURE_FRAMES];
+        if (slot.fence) {
+            retire(slot, true);
+        }
+    }
+    encoders.wait();
+}
+
+bool FrameCapture::is_sequencing() {
+    return sequencing;
+}
+
+bool FrameCapture::is_busy() {
+    if (sequencing || !pending_screenshot.empty() || encoders.get_pending() > 0) {
+        return true;
+    }
+    for (Slot &slot : slots) {
+        if (slot.fence) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int FrameCapture::frames_written() {
+    return written;
+}
+
+float FrameCapture::average_encode_ms() {
+    int frames = written + failed;
+    return frames > 0 ? encode_us / 1000.0f / frames : 0;
+}
@@ -0,0 +1,191 @@
+#include "gl_state.h"
+
+#include "profiler.h"
+
+// nothing is known to be bound until it has been bound through here
+static const unsigned int UNKNOWN = ~0u;
+
+GlState &GlState::get() {
+    static GlState state;
+    return state;
+}
+
+GlState::GlState() {
+    invalidate();
+}
+
+bool GlState::change(unsigned int &cached, unsigned int value) {
+    if (cached == value) {
+        skipped++;
+        if (enabled) {
+            return false;
+        }
+    } else {
+        cached = value;
+    }
+    issued++;
+    return true;
+}
+
+int GlState::target_index(GLenum target) {
+    switch (target) {
+    case GL_TEXTURE_2D:
+        return 0;
+    case GL_TEXTURE_3D:
+        return 1;
+    case GL_TEXTURE_CUBE_MAP:
+        return 2;
+    case GL_TEXTURE_2D_ARRAY:
+        return 3;
+    }
+    return -1;
+}
+
+void GlState::use_program(unsigned int program) {
+    if (change(this->program, program)) {
+        glUseProgram(program);
+    }
+}
+
+void GlState::bind_vertex_array(unsigned int vao) {
+    if (change(this->vao, vao)) {
+        glBindVertexArray(vao);
+    }
+}
+
+void GlState::bind_texture(int unit, GLenum target, unsigned int texture) {
+    active_texture(unit);
+    bind_texture(target, texture);
+}
+
+void GlState::bind_texture(GLenum target, unsigned int texture) {
+    int t = target_index(target);
+    if (unit >= (unsigned int)GL_STATE_UNITS || t < 0) {
+        issued++;
+        glBindTexture(target, texture);
+    } else if (change(textures[unit][t], texture)) {
+        glBindTexture(target, texture);
+    }
+}
+
+void GlState::active_texture(int unit) {
+    if (change(this->unit, (unsigned int)unit)) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+}
+
+void GlState::bind_framebuffer(GLenum target, unsigned int framebuffer) {
+    if (target == GL_READ_FRAMEBUFFER) {
+        if (change(read_framebuffer, framebuffer)) {
+            glBindFramebuffer(target, framebuffer);
+        }
+    } else if (target == GL_DRAW_FRAMEBUFFER) {
+        if (change(draw_framebuffer, framebuffer)) {
+            glBindFramebuffer(target, framebuffer);
+        }
+    } else if (read_framebuffer != framebuffer) {
+        // one call sets both, so it only counts as skipped when neither would change
+        read_framebuffer = draw_framebuffer = framebuffer;
+        issued++;
+        glBindFramebuffer(target, framebuffer);
+    } else if (change(draw_framebuffer, framebuffer)) {
+        read_framebuffer = framebuffer;
+        glBindFramebuffer(target, framebuffer);
+    }
+}
+
+void GlState::enable(GLenum cap) {
+    set_enabled(cap, true);
+}
+
+void GlState::disable(GLenum cap) {
+    set_enabled(cap, false);
+}
+
+void GlState::set_enabled(GLenum cap, bool on) {
+    Cap *entry = nullptr;
+    for (Cap &c : caps) {
+        if (c.cap == cap) {
+            entry = &c;
+            break;
+        }
+    }
+    if (!entry) {
+        caps.push_back({cap, UNKNOWN});
+        entry = &caps.back();
+    }
+    if (change(entry->state, on)) {
+        if (on) {
+            glEnable(cap);
+        } else {
+            glDisable(cap);
+        }
+    }
+}
+
+void GlState::polygon_mode(GLenum mode) {
+    if (change(fill_mode, mode)) {
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+    }
+}
+
+void GlState::delete_textures(int n, const unsigned int *textures) {
+    for (int i = 0; i < n; i++) {
+        for (auto &unit : this->textures) {
+            for (unsigned int &bound : unit) {
+                if (bound == textures[i]) {
+                    bound = 0;
+                }
+            }
+        }
+    }
+    glDeleteTextures(n, textures);
+}
+
+void GlState::delete_vertex_arrays(int n, const unsigned int *vaos) {
+    for (int i = 0; i < n; i++) {
+        if (vao == vaos[i]) {
+            vao = 0;
+        }
+    }
+    glDeleteVertexArrays(n, vaos);
+}
+
+void GlState::delete_framebuffers(int n, const unsigned int *framebuffers) {
+    for (int i = 0; i < n; i++) {
+        if (read_framebuffer == framebuffers[i]) {
+            read_framebuffer = 0;
+        }
+        if (draw_framebuffer == framebuffers[i]) {
+            draw_framebuffer = 0;
+        }
+    }
+    glDeleteFramebuffers(n, framebuffers);
+}
+
+void GlState::delete_program(unsigned int program) {
+    // a program in use stays in use until another one is, but its name is no longer safe to compare against
+    if (this->program == program) {
+        this->program = UNKNOWN;
+    }
+    glDeleteProgram(program);
+}
+
+void GlState::invalidate() {
+    program = vao = read_framebuffer = draw_framebuffer = fill_mode = unit = UNKNOWN;
+    for (auto &unit : textures) {
+        for (unsigned int &bound : unit) {
+            bound = UNKNOWN;
+        }
+    }
+    for (Cap &c : caps) {
+        c.state = UNKNOWN;
+    }
+}
+
+void GlState::end_frame() {
+    Profiler::get().count("gl calls issued", (float)issued);
+    Profiler::get().count("gl calls skipped", (float)skipped);
+    issued = 0;
+    skipped = 0;
+}
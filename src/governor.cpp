@@ -0,0 +1,89 @@
+#include "governor.h"
+
+#include <algorithm>
+
+// knobs of a pass that costs less than this share of the frame are not worth lowering
+const float MIN_PASS_SHARE = 0.1f;
+
+Governor::Governor(Planet &planet) : planet(planet) {
+    knobs = {
+        {"Cloud light steps", &planet.num_cloud_light_pts, 2, 8, POST_PASS, 0, false},
+        {"Cloud steps", &planet.num_cloud_pts, 2, 16, POST_PASS, 0, false},
+        {"Cloud octaves", &planet.cloud_noise_octaves, 2, 8, POST_PASS, 0, false},
+        {"Optical depth steps", &planet.num_od_pts, 3, 20, POST_PASS, 0, false},
+        {"Inscatter steps", &planet.num_inscatter_pts, 4, 20, POST_PASS, 0, false},
+        {"Terrain octaves", &planet.octaves, 4, 16, TERRAIN_PASS, 0, true}};
+}
+
+void Governor::update(float terrain_ms, float post_ms) {
+    // hand the knobs back as they were when switched off
+    if (!enabled) {
+        if (active) {
+            for (QualityKnob &knob : knobs) {
+                *knob.value = knob.user_value;
+            }
+            last_change = "";
+            active = false;
+        }
+        return;
+    }
+    if (!active) {
+        for (QualityKnob &knob : knobs) {
+            knob.user_value = *knob.value;
+        }
+        over_frames = under_frames = settle_frames = 0;
+        active = true;
+    }
+
+    // the timings lag a few frames behind, so wait for a change to show up in them before judging it
+    float total = terrain_ms + post_ms;
+    if (++settle_frames <= GPU_TIMER_FRAMES || total <= 0) {
+        return;
+    }
+
+    if (total > budget_ms * (1 + hysteresis)) {
+        over_frames++;
+        under_frames = 0;
+    } else if (total < budget_ms * (1 - hysteresis)) {
+        under_frames++;
+        over_frames = 0;
+    } else {
+        over_frames = under_frames = 0;
+    }
+
+    if (over_frames >= hold_frames) {
+        lower(terrain_ms, post_ms);
+    } else if (under_frames >= hold_frames) {
+        raise();
+    }
+}
+
+void Governor::lower(float terrain_ms, float post_ms) {
+    float total = terrain_ms + post_ms;
+    for (QualityKnob &knob : knobs) {
+        float pass_ms = knob.pass == TERRAIN_PASS ? terrain_ms : post_ms;
+        if (adjustable(knob) && *knob.value > knob.min_value && pass_ms >= total * MIN_PASS_SHARE) {
+            (*knob.value)--;
+            last_change = "Lowered " + std::string(knob.name) + " to " + std::to_string(*knob.value);
+            over_frames = under_frames = settle_frames = 0;
+            return;
+        }
+    }
+}
+
+void Governor::raise() {
+    for (auto it = knobs.rbegin(); it != knobs.rend(); it++) {
+        if (adjustable(*it) && *it->value < std::min(it->max_value, it->user_value)) {
+            (*it->value)++;
+            last_change = "Raised " + std::string(it->name) + " to " + std::to_string(*it->value);
+            over_frames = under_frames = settle_frames = 0;
+            return;
+        }
+    }
+}
+
+// a baked knob costs nothing per frame while the terrain comes from the cubemap or the tiles, moving it would
+// only throw those away and cause the very hitch the governor is there to avoid
+bool Governor::adjustable(const QualityKnob &knob) {
+    return !knob.baked || !(planet.baked_terrain || planet.virtual_terrain);
+}
@@ -0,0 +1,42 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#include <cstddef>
+
+// call sites (profiler scopes) told apart per frame, allocations past the last one are not broken down
+const int ALLOC_SITES = 32;
+
+struct AllocSite {
+    const char *name;
+    int count;
+    size_t bytes;
+};
+
+// counts every operator new while enabled, by the innermost profiler scope open on the thread that ends the
+// frames (other threads are lumped together); meant to keep the steady-state frame at zero allocations
+class AllocTracker {
+public:
+    static AllocTracker &get();
+
+    // counting costs an atomic add per allocation, so it is off until asked for
+    void set_enabled(bool enabled);
+    bool is_enabled();
+
+    // the scope allocations on this thread are put down to, the profiler keeps it up to date
+    static void set_site(const char *name);
+
+    // take this frame's counts (they become the last frame's) and hand them to the profiler; call once a frame,
+    // always on the same thread
+    void end_frame();
+
+    // the last frame, its sites with the most allocations first
+    int allocations = 0;
+    size_t bytes = 0;
+    AllocSite sites[ALLOC_SITES] = {};
+    int num_sites = 0;
+
+private:
+    AllocTracker() {}
+};
+
+#endif
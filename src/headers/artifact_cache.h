@@ -0,0 +1,156 @@
+#ifndef ARTIFACT_CACHE_H
+#define ARTIFACT_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "hash.h"
+#include "memory_tracker.h"
+
+// bump whenever a baked format or the code producing it changes, every older artifact is then a miss
+const uint32_t ARTIFACT_VERSION = 1;
+
+const char ARTIFACT_MAGIC[4] = {'P', 'A', 'R', 'T'};
+
+// hash of everything an artifact is built from, seeded with its kind and the artifact version
+struct CacheKey {
+    CacheKey(const std::string &kind) : kind(kind) {
+        hash = fnv1a(kind.data(), kind.size());
+        add(ARTIFACT_VERSION);
+    }
+
+    template <typename T>
+    CacheKey &add(const T &value) {
+        hash = fnv1a(&value, sizeof(T), hash);
+        return *this;
+    }
+
+    CacheKey &add(const std::string &value) {
+        add(value.size());
+        hash = fnv1a(value.data(), value.size(), hash);
+        return *this;
+    }
+
+    std::string kind;
+    uint64_t hash;
+};
+
+// an immutable blob, either mapped straight from its file or held in memory
+class Artifact {
+public:
+    Artifact() {}
+    ~Artifact();
+
+    Artifact(const Artifact &) = delete;
+    Artifact &operator=(const Artifact &) = delete;
+
+    // map a whole file read-only, null if it can't be opened or is smaller than min_size
+    static std::shared_ptr<Artifact> map(const std::string &path, size_t min_size = 1);
+
+    const unsigned char *data() const {
+        return bytes;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+private:
+    friend class ArtifactCache;
+
+    const unsigned char *bytes = nullptr;
+    size_t length = 0;
+
+    std::vector<unsigned char> owned;
+    void *mapping = nullptr;
+    size_t mapping_size = 0;
+    TrackedBytes tracked = TrackedBytes(MEMORY_CACHE);
+#ifdef _WIN32
+    void *file_handle = nullptr, *mapping_handle = nullptr;
+#endif
+};
+
+struct CacheStats {
+    int memory_hits = 0;
+    int disk_hits = 0;
+    int misses = 0;
+    float load_ms = 0; // time spent opening artifacts from disk
+};
+
+// content-addressed store for anything that is expensive to rebuild (meshes, decoded images, program binaries)
+// artifacts live in one file each, <directory>/<hash>.art, laid out as magic, version, key, size and the
+// raw bytes, so they can be mapped and used in place; the most recently used ones stay open up to a size cap
+class ArtifactCache {
+public:
+    static ArtifactCache &get();
+
+    // the artifact built from key, or null if it has to be built
+    std::shared_ptr<const Artifact> find(const CacheKey &key);
+
+    // store the concatenation of parts under key and return it
+    std::shared_ptr<const Artifact> store(const CacheKey &key, const std::vector<std::pair<const void *, size_t>> &parts);
+
+    // decode an image file with stb_image to the given number of channels, cached on the file's size and
+    // modification time; the pixels start at image_pixels(artifact)
+    std::shared_ptr<const Artifact> load_image(const std::string &path, int channels, int &width, int &height);
+    static const unsigned char *image_pixels(const Artifact &image);
+
+    // drop everything held in memory, or also every artifact on disk
+    void clear_memory();
+    void clear_disk();
+
+    size_t memory_used();
+    // a running total, the directory is only scanned once and again when the total passes the disk cap
+    size_t disk_used();
+
+    // a copy of stats, which texture loads on worker threads may be updating
+    std::map<std::string, CacheStats> get_stats();
+
+    bool enabled = true;
+    std::string directory = "cache";
+    size_t memory_cap = 256 << 20;
+    // on disk, the artifacts used longest ago are deleted past it
+    size_t disk_cap = (size_t)2048 << 20;
+
+    // artifacts closed to stay under the memory cap, and deleted to stay under the disk cap
+    int evictions = 0;
+    std::atomic<int> disk_evictions{0};
+
+    // per kind of artifact
+    std::map<std::string, CacheStats> stats;
+
+private:
+    ArtifactCache() {}
+
+    std::string file_path(uint64_t hash);
+    std::shared_ptr<Artifact> map_file(const std::string &path, uint64_t hash);
+    void remember(uint64_t hash, std::shared_ptr<const Artifact> artifact);
+    void scan_disk();
+    void trim_disk(const std::string &keep);
+
+    struct Entry {
+        std::shared_ptr<const Artifact> artifact;
+        std::list<uint64_t>::iterator position;
+    };
+
+    std::recursive_mutex mutex;
+    std::list<uint64_t> recent; // most recently used first
+    std::unordered_map<uint64_t, Entry> entries;
+    size_t used = 0;
+
+    // bytes of artifacts on disk, kept up to date by stores and deletions; trims serialise on their own mutex
+    // so the directory is never scanned by two threads at once
+    std::mutex disk_mutex;
+    std::atomic<bool> disk_scanned{false};
+    std::atomic<size_t> disk_bytes{0};
+};
+
+#endif
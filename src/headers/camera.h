@@ -8,6 +8,23 @@
 
 #include <algorithm>
 
+// radical inverse of i in the given base, a low discrepancy sequence in [0, 1) for jittering samples
+inline float halton(int i, int base) {
+    float f = 1, r = 0;
+    while (i > 0) {
+        f /= base;
+        r += f * (i % base);
+        i /= base;
+    }
+    return r;
+}
+
+// everything that decides what the camera sees, for recording and replaying it
+struct CameraState {
+    glm::vec3 position;
+    float yaw, pitch, zoom;
+};
+
 enum CameraMovement {
     FORWARD,
     BACKWARD,
@@ -25,7 +42,16 @@ public:
 
     glm::mat4 get_projection(float aspect) {
         this->aspect = aspect;
-        return glm::perspective(glm::radians(zoom), aspect, near, far);
+        glm::mat4 projection = glm::perspective(glm::radians(zoom), aspect, near, far);
+        // shift the image by the sub-pixel jitter (clip w is -z, hence the minus)
+        projection[2][0] -= jitter.x;
+        projection[2][1] -= jitter.y;
+        return projection;
+    }
+
+    // offset of the projection in ndc, used to jitter the samples of accumulated frames
+    void set_jitter(glm::vec2 jitter) {
+        this->jitter = jitter;
     }
 
     glm::mat4 get_view() {
@@ -44,6 +70,22 @@ public:
         return glm::vec4(near, far, aspect, glm::radians(zoom));
     }
 
+    // screen-space bounds of a sphere as (min uv, max uv), with uv in [0, 1]
+    // falls back to the whole screen when the sphere crosses the near plane (or contains the camera)
+    glm::vec4 get_sphere_bounds(const glm::vec3 &centre, float radius) {
+        glm::vec3 c = glm::vec3(get_view() * glm::vec4(centre, 1.0f));
+        if (c.z + radius > -near) {
+            return glm::vec4(0, 0, 1, 1);
+        }
+
+        float f = 1.0f / tan(glm::radians(zoom) / 2);
+        glm::vec2 bx = project_circle(glm::vec2(c.x, c.z), radius, f / aspect);
+        glm::vec2 by = project_circle(glm::vec2(c.y, c.z), radius, f);
+
+        glm::vec4 bounds = glm::vec4(bx.x, by.x, bx.y, by.y) * 0.5f + 0.5f;
+        return glm::clamp(bounds, 0.0f, 1.0f);
+    }
+
     void process_keyboard(CameraMovement direction, float dt) {
         float velocity = speed * dt;
         switch (direction) {
@@ -85,6 +127,27 @@ public:
         zoom = std::min(90.0f, std::max(1.0f, zoom));
     }
 
+    CameraState get_state() {
+        return {position, yaw, pitch, zoom};
+    }
+
+    void set_state(const CameraState &state) {
+        position = state.position;
+        yaw = state.yaw;
+        pitch = state.pitch;
+        zoom = state.zoom;
+        update_vectors();
+    }
+
+    // place the camera and turn it towards a point (for scripted camera paths)
+    void look_at(glm::vec3 position, glm::vec3 target) {
+        this->position = position;
+        glm::vec3 dir = glm::normalize(target - position);
+        pitch = std::min(89.0f, std::max(-89.0f, glm::degrees(std::asin(dir.y))));
+        yaw = glm::degrees(std::atan2(dir.z, dir.x));
+        update_vectors();
+    }
+
     void set(float speed, float sensitivity, float scroll_sensitivity, float near, float far) {
         this->speed = speed;
         this->sensitivity = sensitivity;
@@ -104,12 +167,22 @@ private:
         up = glm::normalize(glm::cross(right, front));
     }
 
+    // project the two tangent points of a circle (centre p = (axis, z) in view space) onto one ndc axis
+    // the common t / |p|^2 factor of the tangent points cancels out in the perspective divide
+    glm::vec2 project_circle(glm::vec2 p, float r, float scale) {
+        float t = sqrt(glm::dot(p, p) - r * r);
+        float a1 = scale * (t * p.x - r * p.y) / -(t * p.y + r * p.x);
+        float a2 = scale * (t * p.x + r * p.y) / -(t * p.y - r * p.x);
+        return glm::vec2(std::min(a1, a2), std::max(a1, a2));
+    }
+
     glm::vec3 position, front, up, right;
     glm::vec3 world_up = glm::vec3(0, 1, 0);
     float speed, sensitivity, scroll_sensitivity;
     float yaw = -90, pitch = 0, zoom = 45;
     float near = 0.1f, far = 500;
     float aspect;
+    glm::vec2 jitter = glm::vec2(0);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,40 @@
+#ifndef DETAIL_MAP_H
+#define DETAIL_MAP_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+#include "gl_handle.h"
+#include "planet_params.h"
+#include "shader.h"
+
+// a detail normal map projected once onto a sphere (or the terrain on it) by detail.comp, so shading costs
+// one cubemap fetch by direction instead of three planar fetches and three reorientations
+class DetailMap {
+public:
+    DetailMap() {}
+
+    DetailMap(const DetailMap &) = delete;
+    DetailMap &operator=(const DetailMap &) = delete;
+
+    // reproject whenever the normal map, the surface or the resolution change; the surface is model applied to
+    // the unit sphere, or to the terrain of terrain (with its radius) when that is given
+    void update(unsigned int normal_map, const glm::mat4 &model, int resolution, const PlanetParams *terrain = nullptr, float radius = 1);
+
+    void release();
+
+    // bytes held, mips included
+    size_t get_size();
+
+    GlTexture texture;
+
+private:
+    Shader shader;
+    bool built = false;
+    int texture_resolution = 0;
+    TrackedBytes tracked = TrackedBytes(MEMORY_TEXTURE);
+    uint64_t baked_hash = 0;
+};
+
+#endif
@@ -4,12 +4,22 @@
 #include <glm/glm.hpp>
 #include <imgui.h>
 
+#include "alloc_tracker.h"
+#include "artifact_cache.h"
+#include "frame_capture.h"
+#include "gl_state.h"
+#include "governor.h"
 #include "light.h"
+#include "memory_tracker.h"
 #include "planet.h"
+#include "postprocess.h"
+#include "profiler.h"
+#include "recorder.h"
+#include "render_graph.h"
 
 namespace Editor {
 
-void show_editor(Planet &planet, Camera &camera, Light &light, float dt, bool &postprocessing, bool &moving) {
+void show_editor(Planet &planet, Camera &camera, Light &light, PostProcess &post, RenderGraph &graph, Governor &governor, Recorder &recorder, FrameCapture &capture, float dt, bool &postprocessing, bool &moving) {
     ImGui::Begin("Parameter Editor");
 
     ImGui::Text("FPS: %.0f, %.2f ms per frame", 1.0f / dt, dt * 1000);
@@ -24,6 +34,262 @@ void show_editor(Planet &planet, Camera &camera, Light &light, float dt, bool &p
         postprocessing = !postprocessing;
     }
 
+    if (ImGui::CollapsingHeader("Postprocessing")) {
+        static const char *paths[] = {"Fragment shader", "Tiled compute shaders", "Froxel volume"};
+        ImGui::Combo("Path", (int *)&post.path, paths, 3);
+
+        if (post.path == TILED_COMPUTE_PATH) {
+            static const char *effects[] = {"ocean", "clouds", "atmosphere"};
+            ImGui::Text("Tiles per class");
+            for (int i = 0; i < NUM_TILE_CLASSES; i++) {
+                std::string name = i == 0 ? "empty" : "";
+                for (int e = 0; e < 3; e++) {
+                    if (i & (1 << e)) {
+                        name += (name.empty() ? "" : " + ") + std::string(effects[e]);
+                    }
+                }
+                ImGui::Text("  %s: %i", name.c_str(), post.tile_counts[i]);
+            }
+        }
+
+        ImGui::Checkbox("Dynamic resolution", &post.dynamic_resolution);
+        if (post.dynamic_resolution) {
+            ImGui::SliderFloat("Target frame time (ms)", &post.target_ms, 4, 50);
+            ImGui::SliderFloat("Min render scale", &post.min_scale, 0.25f, 1);
+        } else {
+            ImGui::SliderFloat("Render scale", &post.render_scale, post.min_scale, 1);
+        }
+        ImGui::SliderFloat("Upscale sharpness", &post.sharpness, 0, 1);
+        ImGui::Text("GPU %.2f ms at %.0f%% scale", post.frame_timer.get_ms(), post.render_scale * 100);
+
+        ImGui::Checkbox("Progressive accumulation when idle", &post.progressive);
+        if (post.progressive) {
+            ImGui::SliderInt("Max samples", &post.max_samples, 16, 1024);
+            ImGui::SliderFloat("Sample scale", &post.sample_scale, 1, 8);
+            ImGui::SliderInt("Idle frames", &post.idle_delay, 1, 60);
+            ImGui::Text("Accumulated %i / %i", post.accumulated, post.max_samples);
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Quality governor")) {
+        ImGui::Checkbox("Enabled", &governor.enabled);
+        ImGui::SliderFloat("Frame budget (ms)", &governor.budget_ms, 4, 50);
+        ImGui::SliderFloat("Hysteresis", &governor.hysteresis, 0, 0.5f);
+        ImGui::Text("GPU terrain %.2f ms, postprocessing %.2f ms", governor.terrain_timer.get_ms(), post.post_timer.get_ms());
+
+        // bounds of each knob, in the order they are lowered
+        for (QualityKnob &knob : governor.knobs) {
+            ImGui::DragIntRange2(knob.name, &knob.min_value, &knob.max_value, 0.1f, 1, 32);
+            if (governor.enabled && *knob.value != knob.user_value) {
+                ImGui::SameLine();
+                ImGui::Text("%i -> %i", knob.user_value, *knob.value);
+            }
+        }
+        if (governor.enabled) {
+            ImGui::Text("%s", governor.last_change.c_str());
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Profiler")) {
+        Profiler &profiler = Profiler::get();
+        ImGui::Checkbox("Profile", &profiler.enabled);
+        ImGui::SameLine();
+        if (ImGui::Button("Export Chrome trace")) {
+            profiler.export_trace("profile_trace.json");
+        }
+        ImGui::Text("%i frames, %i dropped gpu readbacks", profiler.history_size(), profiler.dropped_frames);
+        ImGui::Checkbox("Save traces of spikes", &profiler.spike_traces);
+        ImGui::SliderFloat("Spike threshold (ms)", &profiler.spike_ms, 17, 500);
+        ImGui::Text("%i spikes, last trace: %s", profiler.spikes, profiler.last_spike_trace.empty() ? "none" : profiler.last_spike_trace.c_str());
+
+        // rolling frame times, the first scope is always the whole frame
+        if (!profiler.stats.empty()) {
+            static float plot[PROFILER_HISTORY];
+            ProfileStat &frame = profiler.stats[0];
+            int n = profiler.timeline(frame.cpu_ms, plot);
+            ImGui::PlotLines("CPU ms", plot, n, 0, NULL, 0, FLT_MAX, ImVec2(0, 60));
+            n = profiler.timeline(frame.gpu_ms, plot);
+            ImGui::PlotLines("GPU ms", plot, n, 0, NULL, 0, FLT_MAX, ImVec2(0, 60));
+        }
+
+        // per pass breakdown, as average / p50 / p95 / p99 in ms
+        ImGui::Columns(3);
+        ImGui::Text("Scope");
+        ImGui::NextColumn();
+        ImGui::Text("CPU avg/p50/p95/p99");
+        ImGui::NextColumn();
+        ImGui::Text("GPU avg/p50/p95/p99");
+        ImGui::NextColumn();
+        ImGui::Separator();
+        for (ProfileStat &stat : profiler.stats) {
+            ImGui::Text("%*s%s", stat.depth * 2, "", stat.name);
+            ImGui::NextColumn();
+            ImGui::Text("%.2f / %.2f / %.2f / %.2f", profiler.average(stat.cpu_ms), profiler.percentile(stat.cpu_ms, 50), profiler.percentile(stat.cpu_ms, 95), profiler.percentile(stat.cpu_ms, 99));
+            ImGui::NextColumn();
+            if (stat.has_gpu) {
+                ImGui::Text("%.2f / %.2f / %.2f / %.2f", profiler.average(stat.gpu_ms), profiler.percentile(stat.gpu_ms, 50), profiler.percentile(stat.gpu_ms, 95), profiler.percentile(stat.gpu_ms, 99));
+            }
+            ImGui::NextColumn();
+        }
+        ImGui::Columns(1);
+
+        // per-frame counts, as average / p95 / max
+        ImGui::Separator();
+        ImGui::Checkbox("Skip redundant GL calls", &GlState::get().enabled);
+        for (ProfileCounter &counter : profiler.counters) {
+            ImGui::Text("%s: %.0f / %.0f / %.0f", counter.name, profiler.average(counter.values), profiler.percentile(counter.values, 95), profiler.percentile(counter.values, 100));
+        }
+
+        // where the last frame's heap allocations came from, by profiler scope
+        ImGui::Separator();
+        AllocTracker &allocs = AllocTracker::get();
+        bool count_allocations = allocs.is_enabled();
+        if (ImGui::Checkbox("Count heap allocations", &count_allocations)) {
+            allocs.set_enabled(count_allocations);
+        }
+        if (count_allocations) {
+            ImGui::Text("Last frame: %i allocations, %.1f KB", allocs.allocations, allocs.bytes / 1024.0f);
+            for (int i = 0; i < allocs.num_sites; i++) {
+                ImGui::BulletText("%s: %i (%.1f KB)", allocs.sites[i].name, allocs.sites[i].count, allocs.sites[i].bytes / 1024.0f);
+            }
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Memory")) {
+        MemoryTracker &memory = MemoryTracker::get();
+        ImGui::Text("%.1f MB on the gpu, %.1f MB on the host", memory.total(true) / 1048576.0f, memory.total(false) / 1048576.0f);
+        ImGui::SameLine();
+        if (ImGui::Button("Reset peaks")) {
+            memory.reset_peaks();
+        }
+
+        // current / peak in MB, and a budget to warn at (0 for none)
+        ImGui::Columns(3);
+        ImGui::Text("Tag");
+        ImGui::NextColumn();
+        ImGui::Text("Current/peak MB");
+        ImGui::NextColumn();
+        ImGui::Text("Budget MB");
+        ImGui::NextColumn();
+        ImGui::Separator();
+        for (int i = 0; i < NUM_MEMORY_TAGS; i++) {
+            MemoryTag tag = (MemoryTag)i;
+            ImGui::Text("%s", MEMORY_TAG_NAMES[i]);
+            ImGui::NextColumn();
+            if (memory.over_budget[i]) {
+                ImGui::TextColored(ImVec4(1, 0.3f, 0.3f, 1), "%.1f / %.1f", memory.current(tag) / 1048576.0f, memory.peak(tag) / 1048576.0f);
+            } else {
+                ImGui::Text("%.1f / %.1f", memory.current(tag) / 1048576.0f, memory.peak(tag) / 1048576.0f);
+            }
+            ImGui::NextColumn();
+            int budget_mb = (int)(memory.budgets[i] >> 20);
+            ImGui::PushID(i);
+            if (ImGui::DragInt("##budget", &budget_mb, 1, 0, 16384)) {
+                memory.budgets[i] = (size_t)budget_mb << 20;
+            }
+            ImGui::PopID();
+            ImGui::NextColumn();
+        }
+        ImGui::Columns(1);
+    }
+
+    if (ImGui::CollapsingHeader("Render graph")) {
+        ImGui::Text("%d passes run, %d culled", graph.passes, graph.culled);
+        ImGui::Text("%d pooled textures, %.1f MB", graph.pooled_textures, graph.pooled_bytes / (1024.0f * 1024.0f));
+        for (int i = 0; i < (int)graph.order.size(); i++) {
+            ImGui::BulletText("%s", graph.order[i]);
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Recording")) {
+        static char path[256] = "flythrough.rec";
+        ImGui::InputText("File", path, sizeof(path));
+        if (recorder.is_recording() || recorder.is_replaying()) {
+            if (ImGui::Button("Stop")) {
+                recorder.stop();
+            }
+            ImGui::SameLine();
+            ImGui::Text("Frame %i", recorder.get_frame());
+        } else {
+            if (ImGui::Button("Record")) {
+                recorder.start_recording(path);
+            }
+            ImGui::SameLine();
+            // anything that reacts to measured timings would make the replay differ from run to run
+            if (ImGui::Button("Replay") && recorder.start_replay(path)) {
+                post.dynamic_resolution = false;
+                governor.enabled = false;
+            }
+            ImGui::SliderFloat("Replay dt", &recorder.replay_dt, 1.0f / 240, 1.0f / 15, "%.4f s");
+        }
+        ImGui::Text("%s", recorder.status.c_str());
+    }
+
+    if (ImGui::CollapsingHeader("Capture")) {
+        static char screenshot_path[256] = "screenshot.png";
+        static char sequence_dir[256] = "frames";
+        static float fps = 60;
+        ImGui::InputText("Screenshot", screenshot_path, sizeof(screenshot_path));
+        ImGui::SameLine();
+        if (ImGui::Button("Save")) {
+            capture.screenshot(screenshot_path);
+        }
+        ImGui::InputText("Sequence folder", sequence_dir, sizeof(sequence_dir));
+        // frames are written at a fixed timestep, so the sequence plays back smoothly however slow it was to capture
+        ImGui::SliderFloat("Sequence fps", &fps, 24, 120, "%.0f");
+        if (capture.is_sequencing()) {
+            if (ImGui::Button("Stop sequence")) {
+                capture.stop_sequence();
+            }
+        } else if (ImGui::Button("Start sequence")) {
+            capture.start_sequence(sequence_dir, fps);
+        }
+        ImGui::Checkbox("Scene only (no post-processing)", &capture.scene_only);
+        ImGui::Text("%i frames written, %.1f ms to encode each, %i stalls", capture.frames_written(), capture.average_encode_ms(), capture.stalls);
+        ImGui::Text("%s", capture.status.c_str());
+    }
+
+    if (ImGui::CollapsingHeader("Artifact cache")) {
+        ArtifactCache &cache = ArtifactCache::get();
+        ImGui::Checkbox("Use cache", &cache.enabled);
+        int cap_mb = (int)(cache.memory_cap >> 20);
+        if (ImGui::SliderInt("Memory cap (MB)", &cap_mb, 16, 2048)) {
+            cache.memory_cap = (size_t)cap_mb << 20;
+        }
+        int disk_cap_mb = (int)(cache.disk_cap >> 20);
+        if (ImGui::SliderInt("Disk cap (MB)", &disk_cap_mb, 64, 16384)) {
+            cache.disk_cap = (size_t)disk_cap_mb << 20;
+        }
+        ImGui::Text("%.1f MB open, %.1f MB on disk, %i evictions, %i deleted from disk", cache.memory_used() / 1048576.0f, cache.disk_used() / 1048576.0f, cache.evictions,
+                    cache.disk_evictions.load());
+        if (ImGui::Button("Clear memory")) {
+            cache.clear_memory();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Clear disk")) {
+            cache.clear_disk();
+        }
+
+        // hits in memory / hits on disk / misses, and the time spent opening the disk hits
+        ImGui::Columns(3);
+        ImGui::Text("Artifact");
+        ImGui::NextColumn();
+        ImGui::Text("Memory/disk/miss");
+        ImGui::NextColumn();
+        ImGui::Text("Load ms");
+        ImGui::NextColumn();
+        ImGui::Separator();
+        for (auto &kind : cache.get_stats()) {
+            ImGui::Text("%s", kind.first.c_str());
+            ImGui::NextColumn();
+            ImGui::Text("%i / %i / %i", kind.second.memory_hits, kind.second.disk_hits, kind.second.misses);
+            ImGui::NextColumn();
+            ImGui::Text("%.2f", kind.second.load_ms);
+            ImGui::NextColumn();
+        }
+        ImGui::Columns(1);
+    }
+
     if (ImGui::CollapsingHeader("Camera settings")) {
         static float speed = 10.0f, sens = 0.1f, scroll_sens = 1.0f, near = 0.01f, far = 500;
         ImGui::SliderFloat("Speed", &speed, 1, 20);
@@ -64,9 +330,10 @@ void show_editor(Planet &planet, Camera &camera, Light &light, float dt, bool &p
     }
 
     if (ImGui::CollapsingHeader("Cubesphere")) {
-        static int n_segments = planet.get_segments();
-        static bool project = planet.get_project();
-        static float radius = planet.get_radius();
+        // read back every frame, a replay changes them too
+        int n_segments = planet.get_segments();
+        bool project = planet.get_project();
+        float radius = planet.get_scale();
         if (ImGui::SliderInt("Segments", &n_segments, 1, 512)) {
             planet.set_squares(n_segments);
         }
@@ -81,6 +348,26 @@ void show_editor(Planet &planet, Camera &camera, Light &light, float dt, bool &p
     }
 
     if (ImGui::CollapsingHeader("Terrain")) {
+        // with a baked terrain the mesh only samples the cubemap, which is rebaked as the sliders below change
+        ImGui::Checkbox("Bake to cubemap", &planet.baked_terrain);
+        static int bake_size = 0;
+        const char *bake_sizes[] = {"1K", "2K", "4K", "8K"};
+        if (ImGui::Combo("Cubemap size", &bake_size, bake_sizes, 4)) {
+            planet.bake_resolution = 1024 << bake_size;
+        }
+        if (planet.baked_terrain) {
+            ImGui::Text("Cubemap: %.0f MB", planet.get_terrain_map_size() / 1048576.0f);
+        }
+
+        // tiles are generated in the background and kept on disk, the gpu only ever holds a fixed atlas of them
+        ImGui::Checkbox("Stream terrain tiles", &planet.virtual_terrain);
+        ImGui::SliderInt("Deepest tile level", &planet.terrain_tiles.max_level, 0, VT_MAX_LEVEL);
+        if (planet.virtual_terrain) {
+            VirtualTerrain &tiles = planet.terrain_tiles;
+            ImGui::Text("%i wanted, %i resident, %i generating, %i generated", tiles.wanted, tiles.resident, tiles.generating, (int)tiles.generated);
+            ImGui::Text("Tile cache: %.1f MB", tiles.gpu_bytes() / 1048576.0f);
+        }
+
         ImGui::SliderFloat("Noise multiplier", &planet.noise_mult, 0, 1);
 
         ImGui::Text("Noise parameters");
@@ -93,6 +380,16 @@ void show_editor(Planet &planet, Camera &camera, Light &light, float dt, bool &p
         ImGui::Text("Normals");
         ImGui::SliderFloat("Normal delta", &planet.noise_params.w, 0.00001f, 0.1f, "%.5f");
         ImGui::SliderFloat("Normal strength", &planet.normal_map_str, 0, 1);
+        // terrain and ocean detail from a cubemap projected once, instead of three lookups per pixel
+        ImGui::Checkbox("Cubemap detail normals", &planet.cubemap_detail);
+        static int detail_size = 1;
+        const char *detail_sizes[] = {"512", "1K", "2K"};
+        if (ImGui::Combo("Detail cubemap size", &detail_size, detail_sizes, 3)) {
+            planet.detail_resolution = 512 << detail_size;
+        }
+        if (planet.cubemap_detail) {
+            ImGui::Text("Detail cubemaps: %.0f MB", (planet.terrain_detail.get_size() + post.water_detail.get_size()) / 1048576.0f);
+        }
 
         ImGui::Text("Ocean floor parameters");
         ImGui::SliderFloat("Ocean depth", &planet.ocean_params.x, 0, 1);
@@ -0,0 +1,79 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <string>
+
+#include "gl_handle.h"
+#include "thread_pool.h"
+
+// reads in flight, a read is mapped this many frames after it was issued so the cpu never waits on the gpu
+const int CAPTURE_FRAMES = 3;
+
+// captures frames without stalling, every read goes into a ring of pixel buffer objects with a fence,
+// is copied out once its fence has signalled, and is encoded to png on worker threads
+class FrameCapture {
+public:
+    FrameCapture(int num_threads = 2);
+
+    // write the next captured frame to path
+    void screenshot(const std::string &path);
+
+    // write every frame to dir/frame_00000.png and on, while time advances by exactly 1 / fps per frame
+    bool start_sequence(const std::string &dir, float fps);
+    void stop_sequence();
+
+    // the given time, or the fixed timestep clock while a sequence is running
+    float frame_time(float time);
+
+    // read the colour buffer of fbo (0 for the window) if a screenshot or sequence wants this frame,
+    // and hand any earlier reads that have landed to the encoders
+    void capture(unsigned int fbo, int width, int height);
+
+    // wait for every read and every encode, call before the gl context goes away
+    void flush();
+
+    bool is_sequencing();
+    bool is_busy(); // anything requested, in flight or being encoded
+
+    int frames_written();
+    float average_encode_ms();
+
+    // capture the scene before the post-process effects instead of the final frame
+    bool scene_only = false;
+
+    // frames whose buffer was still in use, so the capture had to wait for the gpu after all
+    int stalls = 0;
+    std::string status;
+
+private:
+    struct Slot {
+        GlBuffer pbo;
+        GLsync fence = 0;
+        int width = 0, height = 0;
+        size_t size = 0;
+        TrackedBytes tracked = TrackedBytes(MEMORY_BUFFER);
+        std::string path;
+    };
+
+    void retire(Slot &slot, bool wait);
+
+    Slot slots[CAPTURE_FRAMES];
+    int next = 0;
+
+    std::string pending_screenshot;
+
+    bool sequencing = false;
+    std::string sequence_dir;
+    float fps = 60;
+    float start_time = -1;
+    int sequence_frame = 0;
+
+    ThreadPool encoders;
+    std::atomic<int> written{0}, failed{0};
+    std::atomic<long long> encode_us{0};
+};
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef GL_HANDLE_H
+#define GL_HANDLE_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+#include "gl_state.h"
+#include "memory_tracker.h"
+
+// how each kind of object is made and destroyed; deletes go through the state cache so nothing it holds
+// refers to a dead name
+struct GlBufferKind {
+    static unsigned int create() {
+        unsigned int id;
+        glGenBuffers(1, &id);
+        return id;
+    }
+    static void destroy(unsigned int id) {
+        glDeleteBuffers(1, &id);
+    }
+};
+
+struct GlVertexArrayKind {
+    static unsigned int create() {
+        unsigned int id;
+        glGenVertexArrays(1, &id);
+        return id;
+    }
+    static void destroy(unsigned int id) {
+        GlState::get().delete_vertex_arrays(1, &id);
+    }
+};
+
+struct GlTextureKind {
+    static unsigned int create() {
+        unsigned int id;
+        glGenTextures(1, &id);
+        return id;
+    }
+    static void destroy(unsigned int id) {
+        GlState::get().delete_textures(1, &id);
+    }
+};
+
+struct GlFramebufferKind {
+    static unsigned int create() {
+        unsigned int id;
+        glGenFramebuffers(1, &id);
+        return id;
+    }
+    static void destroy(unsigned int id) {
+        GlState::get().delete_framebuffers(1, &id);
+    }
+};
+
+struct GlProgramKind {
+    static unsigned int create() {
+        return glCreateProgram();
+    }
+    static void destroy(unsigned int id) {
+        GlState::get().delete_program(id);
+    }
+};
+
+// sole owner of a gl object, deleted along with its owner; it can be moved but never copied, so an object
+// is never deleted twice or left behind when the owner is rebuilt, and it reads as the plain name
+template <typename Kind>
+class GlHandle {
+public:
+    GlHandle() {}
+    explicit GlHandle(unsigned int id) : id(id) {}
+
+    GlHandle(GlHandle &&other) : id(other.release()) {}
+    GlHandle &operator=(GlHandle &&other) {
+        if (this != &other) {
+            reset(other.release());
+        }
+        return *this;
+    }
+
+    GlHandle(const GlHandle &) = delete;
+    GlHandle &operator=(const GlHandle &) = delete;
+
+    ~GlHandle() {
+        reset();
+    }
+
+    // a new object (names from glGen* only become objects once bound)
+    static GlHandle generate() {
+        return GlHandle(Kind::create());
+    }
+
+    // delete the object held, if any, and take over another one
+    void reset(unsigned int id = 0) {
+        if (this->id) {
+            Kind::destroy(this->id);
+        }
+        this->id = id;
+    }
+
+    // give up ownership without deleting it
+    unsigned int release() {
+        unsigned int id = this->id;
+        this->id = 0;
+        return id;
+    }
+
+    operator unsigned int() const {
+        return id;
+    }
+
+private:
+    unsigned int id = 0;
+};
+
+typedef GlHandle<GlBufferKind> GlBuffer;
+typedef GlHandle<GlVertexArrayKind> GlVertexArray;
+typedef GlHandle<GlTextureKind> GlTexture;
+typedef GlHandle<GlFramebufferKind> GlFramebuffer;
+typedef GlHandle<GlProgramKind> GlProgram;
+
+// a buffer whose storage is kept across uploads: data that fits is written over the old contents (orphaning
+// them first, so a draw still reading them does not stall the upload) and it only grows when it has to;
+// its storage is counted under tag
+class GlStreamBuffer {
+public:
+    GlStreamBuffer(MemoryTag tag, GLenum usage = GL_STATIC_DRAW) : usage(usage), tracked(tag) {}
+
+    void upload(const void *data, size_t size) {
+        if (!buffer) {
+            buffer = GlBuffer::generate();
+            // the name becomes a buffer on its first bind, after which the dsa calls below can use it
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        if (size > capacity) {
+            glNamedBufferData(buffer, size, data, usage);
+            capacity = size;
+            tracked.set(capacity);
+        } else {
+            glNamedBufferData(buffer, capacity, NULL, usage);
+            glNamedBufferSubData(buffer, 0, size, data);
+        }
+        this->size = size;
+    }
+
+    operator unsigned int() const {
+        return buffer;
+    }
+
+    size_t get_size() const {
+        return size;
+    }
+
+    size_t get_capacity() const {
+        return capacity;
+    }
+
+private:
+    GlBuffer buffer;
+    GLenum usage;
+    size_t size = 0, capacity = 0;
+    TrackedBytes tracked;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+// texture units and targets whose bindings are tracked, binds outside them are always issued
+const int GL_STATE_UNITS = 16;
+const int GL_STATE_TARGETS = 4;
+
+// a cache of the bound programs, vertex arrays, textures, framebuffers and enables, so binding what is
+// already bound costs nothing; every such call in the renderer goes through here, and anything that changes
+// this state behind its back (imgui restores what it touches) has to invalidate it
+class GlState {
+public:
+    static GlState &get();
+
+    void use_program(unsigned int program);
+    void bind_vertex_array(unsigned int vao);
+
+    // bind on a unit, which is left active
+    void bind_texture(int unit, GLenum target, unsigned int texture);
+    // bind on the active unit, for creating and updating textures
+    void bind_texture(GLenum target, unsigned int texture);
+    void active_texture(int unit);
+
+    // GL_FRAMEBUFFER binds both the read and the draw framebuffer
+    void bind_framebuffer(GLenum target, unsigned int framebuffer);
+
+    void enable(GLenum cap);
+    void disable(GLenum cap);
+    void set_enabled(GLenum cap, bool on);
+    void polygon_mode(GLenum mode);
+
+    // deleted objects are unbound wherever they were bound, and their names can be handed out again
+    void delete_textures(int n, const unsigned int *textures);
+    void delete_vertex_arrays(int n, const unsigned int *vaos);
+    void delete_framebuffers(int n, const unsigned int *framebuffers);
+    void delete_program(unsigned int program);
+
+    // forget everything, the next call of each kind is issued
+    void invalidate();
+
+    // hand this frame's call counts to the profiler and start counting the next one
+    void end_frame();
+
+    // when off every call is issued, to compare against
+    bool enabled = true;
+
+    // calls made to gl this frame, and those that would not have changed anything (skipped unless disabled)
+    int issued = 0, skipped = 0;
+
+private:
+    GlState();
+
+    // false (and counted as skipped) when the cached value already matches, otherwise caches it
+    bool change(unsigned int &cached, unsigned int value);
+    int target_index(GLenum target);
+
+    struct Cap {
+        GLenum cap;
+        unsigned int state;
+    };
+
+    unsigned int program, vao, read_framebuffer, draw_framebuffer, fill_mode, unit;
+    unsigned int textures[GL_STATE_UNITS][GL_STATE_TARGETS];
+    std::vector<Cap> caps;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <string>
+#include <vector>
+
+#include "gpu_timer.h"
+#include "planet.h"
+
+enum GovernorPass {
+    TERRAIN_PASS,
+    POST_PASS
+};
+
+// one integer quality setting the governor may move between its bounds
+struct QualityKnob {
+    const char *name;
+    int *value;
+    int min_value, max_value;
+    GovernorPass pass; // the pass whose cost it drives
+    int user_value;    // what it was set to before the governor took over
+    bool baked;        // read only when the terrain is baked or streamed, where changing it just forces a rebake
+};
+
+// trades march steps and noise octaves for frame time, lowering knobs in priority order when over budget
+// and raising them back in reverse order when there is headroom
+class Governor {
+public:
+    Governor(Planet &planet);
+
+    // feed the latest per-pass gpu times, adjusts at most one knob per call
+    void update(float terrain_ms, float post_ms);
+
+    bool enabled = false;
+    float budget_ms = 16.6f;
+    float hysteresis = 0.15f; // fraction of the budget either side of it that is left alone
+    int hold_frames = 20;     // frames the time has to stay outside the band before acting
+
+    // lowered first to last, cloud light steps first and terrain octaves last
+    std::vector<QualityKnob> knobs;
+
+    // wrapped around the terrain draw
+    GpuTimer terrain_timer;
+
+    std::string last_change;
+
+private:
+    void lower(float terrain_ms, float post_ms);
+    void raise();
+    bool adjustable(const QualityKnob &knob);
+
+    Planet &planet;
+
+    bool active = false;
+    int over_frames = 0, under_frames = 0;
+    int settle_frames = 0;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+// queries in flight, results are read this many frames late so the cpu never waits on the gpu
+const int GPU_TIMER_FRAMES = 4;
+
+// times a span of gpu work with a ring of timestamp query pairs (unlike elapsed time queries, these can nest)
+class GpuTimer {
+public:
+    void begin() {
+        if (!created) {
+            glGenQueries(GPU_TIMER_FRAMES * 2, queries);
+            created = true;
+        }
+
+        // collect the oldest pair before reusing it, keeping the last result if it is not ready yet
+        unsigned int *pair = &queries[(frame % GPU_TIMER_FRAMES) * 2];
+        if (frame >= GPU_TIMER_FRAMES) {
+            int available = 0;
+            glGetQueryObjectiv(pair[1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint64 start = 0, end = 0;
+                glGetQueryObjectui64v(pair[0], GL_QUERY_RESULT, &start);
+                glGetQueryObjectui64v(pair[1], GL_QUERY_RESULT, &end);
+                ms = (end - start) / 1e6f;
+            }
+        }
+        glQueryCounter(pair[0], GL_TIMESTAMP);
+    }
+
+    void end() {
+        glQueryCounter(queries[(frame % GPU_TIMER_FRAMES) * 2 + 1], GL_TIMESTAMP);
+        frame++;
+    }
+
+    // the most recent finished measurement, 0 until one is available
+    float get_ms() {
+        return ms;
+    }
+
+private:
+    unsigned int queries[GPU_TIMER_FRAMES * 2];
+    bool created = false;
+    int frame = 0;
+    float ms = 0;
+};
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// minimal json reader, enough for the files the tools write and read back themselves
+struct JsonValue {
+    enum Type {
+        NUL,
+        BOOLEAN,
+        NUMBER,
+        STRING,
+        ARRAY,
+        OBJECT
+    };
+
+    Type type = NUL;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    // member of an object, or null if there is no such key
+    const JsonValue *get(const std::string &key) const {
+        for (const auto &member : object) {
+            if (member.first == key) {
+                return &member.second;
+            }
+        }
+        return nullptr;
+    }
+
+    double get_number(const std::string &key, double fallback = 0) const {
+        const JsonValue *value = get(key);
+        return value && value->type == NUMBER ? value->number : fallback;
+    }
+
+    std::string get_string(const std::string &key, const std::string &fallback = "") const {
+        const JsonValue *value = get(key);
+        return value && value->type == STRING ? value->string : fallback;
+    }
+};
+
+class JsonParser {
+public:
+    JsonParser(const std::string &text) : p(text.c_str()), end(text.c_str() + text.size()) {}
+
+    bool parse(JsonValue &out) {
+        if (!parse_value(out)) {
+            return false;
+        }
+        skip_space();
+        return p == end;
+    }
+
+private:
+    void skip_space() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            p++;
+        }
+    }
+
+    bool match(const char *word) {
+        const char *q = p;
+        for (; *word; word++, q++) {
+            if (q >= end || *q != *word) {
+                return false;
+            }
+        }
+        p = q;
+        return true;
+    }
+
+    bool parse_string(std::string &out) {
+        if (p >= end || *p != '"') {
+            return false;
+        }
+        p++;
+        while (p < end && *p != '"') {
+            if (*p == '\\' && p + 1 < end) {
+                p++;
+                switch (*p) {
+                case 'n':
+                    out += '\n';
+                    break;
+                case 't':
+                    out += '\t';
+                    break;
+                case 'r':
+                    out += '\r';
+                    break;
+                case 'u':
+                    // only ascii is ever written, anything else becomes a placeholder
+                    out += '?';
+                    p += 4;
+                    break;
+                default:
+                    out += *p;
+                }
+            } else {
+                out += *p;
+            }
+            p++;
+        }
+        if (p >= end) {
+            return false;
+        }
+        p++;
+        return true;
+    }
+
+    bool parse_value(JsonValue &out) {
+        skip_space();
+        if (p >= end) {
+            return false;
+        }
+        if (*p == '{') {
+            out.type = JsonValue::OBJECT;
+            p++;
+            skip_space();
+            if (p < end && *p == '}') {
+                p++;
+                return true;
+            }
+            while (true) {
+                std::pair<std::string, JsonValue> member;
+                skip_space();
+                if (!parse_string(member.first)) {
+                    return false;
+                }
+                skip_space();
+                if (p >= end || *p != ':') {
+                    return false;
+                }
+                p++;
+                if (!parse_value(member.second)) {
+                    return false;
+                }
+                out.object.push_back(std::move(member));
+                skip_space();
+                if (p < end && *p == ',') {
+                    p++;
+                } else if (p < end && *p == '}') {
+                    p++;
+                    return true;
+                } else {
+                    return false;
+                }
+            }
+        }
+        if (*p == '[') {
+            out.type = JsonValue::ARRAY;
+            p++;
+            skip_space();
+            if (p < end && *p == ']') {
+                p++;
+                return true;
+            }
+            while (true) {
+                out.array.emplace_back();
+                if (!parse_value(out.array.back())) {
+                    return false;
+                }
+                skip_space();
+                if (p < end && *p == ',') {
+                    p++;
+                } else if (p < end && *p == ']') {
+                    p++;
+                    return true;
+                } else {
+                    return false;
+                }
+            }
+        }
+        if (*p == '"') {
+            out.type = JsonValue::STRING;
+            return parse_string(out.string);
+        }
+        if (match("true")) {
+            out.type = JsonValue::BOOLEAN;
+            out.boolean = true;
+            return true;
+        }
+        if (match("false")) {
+            out.type = JsonValue::BOOLEAN;
+            return true;
+        }
+        if (match("null")) {
+            out.type = JsonValue::NUL;
+            return true;
+        }
+        char *number_end;
+        out.number = strtod(p, &number_end);
+        if (number_end == p) {
+            return false;
+        }
+        out.type = JsonValue::NUMBER;
+        p = number_end;
+        return true;
+    }
+
+    const char *p, *end;
+};
+
+inline bool load_json(const std::string &path, JsonValue &out) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cout << "Failed to open " << path << std::endl;
+        return false;
+    }
+    std::stringstream stream;
+    stream << file.rdbuf();
+    if (!JsonParser(stream.str()).parse(out)) {
+        std::cout << "Failed to parse " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// quote a string for writing into json
+inline std::string json_quote(const std::string &s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else if ((unsigned char)c >= 0x20) {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+#endif
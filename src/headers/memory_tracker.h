@@ -0,0 +1,93 @@
+#ifndef MEMORY_TRACKER_H
+#define MEMORY_TRACKER_H
+
+#include <atomic>
+#include <cstddef>
+
+// what memory is spent on, everything but the cache lives on the gpu
+enum MemoryTag {
+    MEMORY_MESH,
+    MEMORY_TEXTURE,
+    MEMORY_RENDER_TARGET,
+    MEMORY_BUFFER, // compute, readback and upload buffers
+    MEMORY_CACHE, // artifacts held open by the host, mapped or in memory
+    NUM_MEMORY_TAGS
+};
+
+const char *const MEMORY_TAG_NAMES[NUM_MEMORY_TAGS] = {"mesh", "texture", "render target", "buffer", "cache"};
+const bool MEMORY_TAG_GPU[NUM_MEMORY_TAGS] = {true, true, true, true, false};
+
+// bytes in use per tag, and the most there has been, fed by every owner of a gl object or large host buffer
+// through TrackedBytes; counts can change on any thread
+class MemoryTracker {
+public:
+    static MemoryTracker &get();
+
+    void add(MemoryTag tag, size_t bytes);
+    void remove(MemoryTag tag, size_t bytes);
+
+    size_t current(MemoryTag tag);
+    size_t peak(MemoryTag tag);
+    // over every tag on the gpu, or on the host
+    size_t total(bool gpu);
+
+    void reset_peaks();
+
+    // once a frame, warns about each tag that has gone over its budget (and again only once it has been back under)
+    void check_budgets();
+
+    // bytes a tag may use before it warns, 0 for no budget
+    size_t budgets[NUM_MEMORY_TAGS] = {};
+    bool over_budget[NUM_MEMORY_TAGS] = {};
+
+private:
+    MemoryTracker() {}
+
+    std::atomic<size_t> used[NUM_MEMORY_TAGS] = {};
+    std::atomic<size_t> peaks[NUM_MEMORY_TAGS] = {};
+};
+
+// the size of one allocation, counted under its tag until it is set to 0 or its owner goes
+class TrackedBytes {
+public:
+    TrackedBytes(MemoryTag tag) : tag(tag) {}
+
+    TrackedBytes(TrackedBytes &&other) : tag(other.tag), bytes(other.bytes) {
+        other.bytes = 0;
+    }
+    TrackedBytes &operator=(TrackedBytes &&other) {
+        if (this != &other) {
+            set(0);
+            tag = other.tag;
+            bytes = other.bytes;
+            other.bytes = 0;
+        }
+        return *this;
+    }
+
+    TrackedBytes(const TrackedBytes &) = delete;
+    TrackedBytes &operator=(const TrackedBytes &) = delete;
+
+    ~TrackedBytes() {
+        set(0);
+    }
+
+    void set(size_t bytes) {
+        if (bytes > this->bytes) {
+            MemoryTracker::get().add(tag, bytes - this->bytes);
+        } else if (bytes < this->bytes) {
+            MemoryTracker::get().remove(tag, this->bytes - bytes);
+        }
+        this->bytes = bytes;
+    }
+
+    size_t get() const {
+        return bytes;
+    }
+
+private:
+    MemoryTag tag;
+    size_t bytes = 0;
+};
+
+#endif
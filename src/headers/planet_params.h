@@ -0,0 +1,131 @@
+#ifndef PLANET_PARAMS_H
+#define PLANET_PARAMS_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+#include "hash.h"
+
+// every tweakable parameter of a planet, kept apart from the gpu resources so it can be
+// copied, compared and stored on its own
+struct PlanetParams {
+    // noise parameters
+    // float noise_mult = 0.0f;
+    float noise_mult = 0.23f;
+    glm::vec3 offset = glm::vec3(0);
+    int octaves = 11;
+    glm::vec4 noise_params = glm::vec4(1, 0.5f, 2, 0.01f);
+    float normal_map_str = 1;
+
+    // ocean floor
+    glm::vec3 ocean_params = glm::vec3(0.5f, 0.05f, 3.2f);
+
+    // ocean
+    float ocean_radius = 0.993f;
+    glm::vec3 ocean_shallow_colour = glm::vec3(0.22f, 0.34f, 0.44f);
+    glm::vec3 ocean_deep_colour = glm::vec3(0.001f, 0.026f, 0.27f);
+    glm::vec2 ocean_blends = glm::vec2(0.7f, 50);
+    glm::vec2 ocean_wave_speed = glm::vec2(0.3f, 0.3f);
+    float ocean_wave_strength = 0.5f;
+    float ocean_shininess = 256;
+
+    // terrain colours
+    glm::vec3 grass_colour = glm::vec3(0.31f, 0.34f, 0);
+    glm::vec3 rock_colour = glm::vec3(0.23f, 0.11f, 0.07f);
+    glm::vec3 snow_colour = glm::vec3(0.9f, 0.9f, 0.9f);
+    glm::vec3 shore_colour = glm::vec3(0.62f, 0.55f, 0.28f);
+    glm::vec3 seafloor_colour = glm::vec3(0.28f, 0.27f, 0.24f);
+    glm::vec4 colour_params = glm::vec4(0.16f, 0.77f, 0.45f, 0.14f);
+    glm::vec4 colour_params2 = glm::vec4(0.38f, 0.34f, 0.14f, 0.75f);
+    glm::vec2 seafloor_params = glm::vec2(0.05f, 0.9f);
+
+    // lighting
+    float shininess = 1;
+    float spec_str = 1;
+
+    // atmosphere
+    float atmosphere_radius = 2.5f;
+    int num_inscatter_pts = 10;
+    int num_od_pts = 10;
+    float density_falloff = 10;
+    glm::vec3 rgb_wavelengths = glm::vec3(700, 530, 440);
+    float scatter_str = 20;
+
+    // clouds
+    glm::vec2 cloud_radii = glm::vec2(1.2f, 1.5f);
+    int num_cloud_pts = 4;
+    int cloud_noise_octaves = 6;
+    glm::vec3 cloud_speed = glm::vec3(1);
+    glm::vec3 cloud_noise = glm::vec3(1.2, 0.5f, 2);
+    int num_cloud_light_pts = 4;
+    float cloud_transmittance = 1.5f;
+    float hg_g = 0.85f;
+    float extinction = -3.3f;
+
+    // visit every parameter as f(name, value), in declaration order
+    template <typename F>
+    void for_each_param(F &&f) {
+        // noise parameters
+        f("noise_mult", noise_mult);
+        f("offset", offset);
+        f("octaves", octaves);
+        f("noise_params", noise_params);
+        f("normal_map_str", normal_map_str);
+
+        // ocean floor
+        f("ocean_params", ocean_params);
+
+        // ocean
+        f("ocean_radius", ocean_radius);
+        f("ocean_shallow_colour", ocean_shallow_colour);
+        f("ocean_deep_colour", ocean_deep_colour);
+        f("ocean_blends", ocean_blends);
+        f("ocean_wave_speed", ocean_wave_speed);
+        f("ocean_wave_strength", ocean_wave_strength);
+        f("ocean_shininess", ocean_shininess);
+
+        // terrain colours
+        f("grass_colour", grass_colour);
+        f("rock_colour", rock_colour);
+        f("snow_colour", snow_colour);
+        f("shore_colour", shore_colour);
+        f("seafloor_colour", seafloor_colour);
+        f("colour_params", colour_params);
+        f("colour_params2", colour_params2);
+        f("seafloor_params", seafloor_params);
+
+        // lighting
+        f("shininess", shininess);
+        f("spec_str", spec_str);
+
+        // atmosphere
+        f("atmosphere_radius", atmosphere_radius);
+        f("num_inscatter_pts", num_inscatter_pts);
+        f("num_od_pts", num_od_pts);
+        f("density_falloff", density_falloff);
+        f("rgb_wavelengths", rgb_wavelengths);
+        f("scatter_str", scatter_str);
+
+        // clouds
+        f("cloud_radii", cloud_radii);
+        f("num_cloud_pts", num_cloud_pts);
+        f("cloud_noise_octaves", cloud_noise_octaves);
+        f("cloud_speed", cloud_speed);
+        f("cloud_noise", cloud_noise);
+        f("num_cloud_light_pts", num_cloud_light_pts);
+        f("cloud_transmittance", cloud_transmittance);
+        f("hg_g", hg_g);
+        f("extinction", extinction);
+    }
+
+    uint64_t hash() {
+        uint64_t h = FNV_OFFSET;
+        for_each_param([&](const char *, auto &value) {
+            h = fnv1a(&value, sizeof(value), h);
+        });
+        return h;
+    }
+};
+
+#endif
\ No newline at end of file
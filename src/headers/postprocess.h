@@ -0,0 +1,148 @@
+#ifndef POSTPROCESS_H
+#define POSTPROCESS_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+#include "camera.h"
+#include "detail_map.h"
+#include "gl_handle.h"
+#include "gpu_timer.h"
+#include "light.h"
+#include "planet.h"
+#include "render_graph.h"
+#include "shader.h"
+#include "texture_loader.h"
+
+// tiles are binned by a bitmask of the effects they touch (ocean 1, clouds 2, atmosphere 4)
+const int NUM_TILE_CLASSES = 8;
+const int TILE_SIZE = 16;
+
+// granularity of the dynamic render scale
+const float SCALE_STEP = 0.05f;
+
+// camera-aligned volume the froxel path integrates the atmosphere and clouds into
+const glm::ivec3 FROXEL_SIZE = glm::ivec3(160, 90, 64);
+
+enum PostProcessPath {
+    FRAGMENT_PATH,
+    TILED_COMPUTE_PATH,
+    FROXEL_PATH
+};
+
+class PostProcess {
+public:
+    PostProcess(int width, int height);
+    ~PostProcess();
+
+    // the new window size, the render targets follow it in the next begin_frame
+    void resize(int width, int height);
+
+    // declare the offscreen targets the scene is rendered into, at the render size
+    void add_scene_targets(RenderGraph &graph, RenderResource &colour, RenderResource &depth);
+
+    // detect whether the view is idle, size the render targets and jitter the camera for this frame if a still
+    // is being accumulated; returns the time to render at, which is frozen while accumulating
+    float begin_frame(Planet &planet, Camera &camera, Light &light, float time);
+
+    // add the passes that apply the ocean, clouds and atmosphere to the scene and present it to the window
+    void add_passes(RenderGraph &graph, RenderResource colour, RenderResource depth, Planet &planet, Camera &camera, Light &light, float time);
+
+    // the accumulated still is done, so the scene does not need to be rendered at all
+    bool is_converged();
+
+    // jittered, higher quality frames are being accumulated (their timings are not representative)
+    bool is_accumulating();
+
+    glm::ivec2 get_render_size();
+
+    // full-screen fragment shader, tile-classified compute kernels or froxel volume
+    PostProcessPath path = FRAGMENT_PATH;
+
+    // number of tiles in each class, read back once the gpu is done with them to avoid stalling
+    int tile_counts[NUM_TILE_CLASSES] = {};
+
+    // dynamic resolution, scales the render targets to hold the gpu frame time near the target
+    bool dynamic_resolution = false;
+    float render_scale = 1;
+    float min_scale = 0.5f;
+    float target_ms = 16.6f;
+    float sharpness = 0.5f;
+
+    // the scene and post-process together, and the post-process alone
+    GpuTimer frame_timer;
+    GpuTimer post_timer;
+
+    // progressive mode, averages jittered frames with more march steps while nothing changes
+    bool progressive = false;
+    int idle_delay = 10; // frames the view has to stay unchanged before accumulating
+    int max_samples = 256;
+    float sample_scale = 4; // multiplier on the march step counts of accumulated frames
+    int accumulated = 0;
+
+    // the water normal map projected onto the ocean, while the planet asks for cubemap detail
+    DetailMap water_detail;
+
+private:
+    void allocate(int width, int height);
+    void update_scale(bool accumulating);
+
+    uint64_t view_signature(Planet &planet, Camera &camera, Light &light);
+
+    // the first pass of the effects starts timing them and the last one stops
+    void begin_effects(Planet &planet, bool effects);
+    void end_effects(Camera &camera, bool effects);
+
+    RenderResource add_accumulate(RenderGraph &graph, RenderResource current, RenderResource history);
+    void add_present(RenderGraph &graph, RenderResource source, Planet &planet, Camera &camera, bool effects);
+
+    void set_uniforms(Shader &shader, Planet &planet, Camera &camera, Light &light, float time);
+
+    // each returns the version of the target it wrote
+    RenderResource add_fragment(RenderGraph &graph, Shader &shader, RenderResource colour, RenderResource depth, RenderResource froxels, RenderResource output,
+                                Planet &planet, Camera &camera, Light &light, float time, bool first, bool last);
+    RenderResource add_compute(RenderGraph &graph, RenderResource colour, RenderResource depth, RenderResource output, Planet &planet, Camera &camera, Light &light,
+                               float time, bool last);
+    RenderResource add_froxel_volume(RenderGraph &graph, Planet &planet, Camera &camera, Light &light, float time);
+
+    int window_width, window_height;
+    int width, height; // render size
+    int settle_frames = 0;
+    int tiles_x, tiles_y;
+    int frame = 0;
+
+    GlVertexArray quad_vao;
+    GlBuffer quad_vbo;
+    std::shared_ptr<StreamedTexture> water_normal_tex;
+
+    // the accumulated still, the only target that outlives a frame
+    GlTexture tex_history;
+    TrackedBytes history_bytes = TrackedBytes(MEMORY_RENDER_TARGET);
+
+    uint64_t signature = 0;
+    int idle_frames = 0;
+    float frozen_time = 0;
+    float march_offset = 0.5f;
+    float step_scale = 1;
+
+    // indirect dispatch arguments and tile lists for the compute path
+    GlBuffer dispatch_buffer, tile_buffer;
+    // each copy of the counts has a fence, and is only read once it has signalled
+    GlBuffer readback_buffers[3];
+    GLsync readback_fences[3] = {};
+    TrackedBytes tile_bytes = TrackedBytes(MEMORY_BUFFER);
+
+    Shader screen_shader = Shader("data/shaders/framebuffer.vert", "data/shaders/framebuffer.frag");
+    Shader classify_shader;
+    Shader tile_shaders[NUM_TILE_CLASSES];
+
+    Shader froxel_shader = Shader("data/shaders/framebuffer.vert", "data/shaders/froxel.frag");
+    Shader froxel_inject_shader;
+    Shader froxel_accumulate_shader;
+
+    Shader accumulate_shader = Shader("data/shaders/framebuffer.vert", "data/shaders/accumulate.frag");
+    Shader upscale_shader = Shader("data/shaders/framebuffer.vert", "data/shaders/upscale.frag");
+};
+
+#endif
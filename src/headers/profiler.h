@@ -0,0 +1,164 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "thread_pool.h"
+
+// frames of gpu queries in flight, a frame's gpu times are read back this many frames later
+const int PROFILER_FRAMES = 4;
+// frames kept for the graphs, percentiles and trace export
+const int PROFILER_HISTORY = 256;
+// scopes a frame is expected to have, room for them is made up front so recording does not allocate
+const int PROFILER_FRAME_SCOPES = 64;
+// frames at the start that are never spikes, they load and compile everything
+const int PROFILER_SPIKE_WARMUP = 60;
+// frames recorded after a spike before its trace is written, to show the recovery (and fold in the spikes
+// that follow it)
+const int PROFILER_SPIKE_AFTER = 60;
+
+// one timed scope of one frame, on the cpu timeline (gpu times are mapped onto it)
+struct ProfileEvent {
+    const char *name;
+    int depth;
+    bool gpu;
+    double start_us, end_us;
+};
+
+// a counter's value in one frame, plotted from the start of that frame
+struct ProfileSample {
+    const char *name;
+    double start_us;
+    float value;
+};
+
+// recorded frames copied out, so they can be written while recording goes on
+struct ProfileTrace {
+    std::vector<ProfileEvent> events;
+    std::vector<ProfileSample> samples;
+};
+
+// rolling per-frame times of every scope with the same name (summed if it runs more than once a frame)
+struct ProfileStat {
+    const char *name;
+    int depth;
+    bool has_gpu;
+    float cpu_ms[PROFILER_HISTORY];
+    float gpu_ms[PROFILER_HISTORY];
+};
+
+// a per-frame count of something (draw calls, state changes), summed if it is counted more than once a frame
+struct ProfileCounter {
+    const char *name;
+    float values[PROFILER_HISTORY];
+};
+
+// nested cpu scopes, optionally also timed on the gpu with timestamp queries that are never waited on
+// names must be string literals (they are kept by pointer)
+class Profiler {
+public:
+    static Profiler &get();
+
+    void begin_frame();
+    void end_frame();
+
+    void begin(const char *name, bool gpu = false);
+    void end();
+
+    // add to a counter for the frame being recorded
+    void count(const char *name, float value);
+
+    // p-th percentile (0 to 100) of the frames whose gpu times have been read back
+    float percentile(const float *samples, float p);
+    // average of those frames
+    float average(const float *samples);
+    // copy those frames out oldest first, returns how many there are
+    int timeline(const float *samples, float *out);
+
+    // write the recorded frames as a chrome://tracing (or perfetto) json file
+    bool export_trace(const std::string &path);
+
+    // the history is always being recorded, so when a frame takes longer than spike_ms (on the cpu or the gpu)
+    // it is written out on a worker thread as spike_trace_<frame>.json, the frames before and after included
+    bool spike_traces = true;
+    float spike_ms = 100;
+    int spikes = 0; // frames over the threshold so far
+    std::string last_spike_trace;
+
+    bool enabled = true;
+    std::vector<ProfileStat> stats;
+    std::vector<ProfileCounter> counters;
+
+    // the newest frame with complete (cpu and gpu) times, and how many frames of history there are
+    long long frame = -1;
+    int history_size();
+    int history_index(long long frame);
+
+    // the frame being recorded now, its gpu times show up PROFILER_FRAMES frames later
+    long long current_frame() {
+        return current;
+    }
+
+    // frames whose gpu queries were still not done when their slot was reused
+    int dropped_frames = 0;
+
+private:
+    Profiler();
+
+    struct OpenScope {
+        int stat;
+        int depth;
+        double start_us;
+        int query;
+    };
+
+    struct GpuScope {
+        int stat;
+        int depth;
+        int begin_query, end_query;
+    };
+
+    // the queries of one frame in flight
+    struct GpuFrame {
+        std::vector<unsigned int> queries;
+        std::vector<GpuScope> scopes;
+        int used = 0;
+        long long frame = -1;
+        double offset_us = 0; // cpu time minus gpu time, sampled when the frame started
+    };
+
+    int find_stat(const char *name, int depth, bool gpu);
+    int next_query(GpuFrame &slot);
+    void resolve(GpuFrame &slot);
+    void check_spike();
+    void snapshot(ProfileTrace &trace);
+    static bool write_trace(const ProfileTrace &trace, const std::string &path);
+    double now_us();
+
+    bool recording = false;
+    std::vector<OpenScope> stack;
+    GpuFrame gpu_frames[PROFILER_FRAMES];
+    std::vector<ProfileEvent> events[PROFILER_HISTORY];
+    long long current = -1;
+    std::vector<float> scratch;
+
+    long long checked = -1; // the newest frame looked at for spikes
+    long long spike = -1; // the first spike of the trace waiting to be written
+    std::unique_ptr<ThreadPool> writer;
+};
+
+// times the enclosing block
+class ProfileScope {
+public:
+    ProfileScope(const char *name, bool gpu = false) {
+        Profiler::get().begin(name, gpu);
+    }
+
+    ~ProfileScope() {
+        Profiler::get().end();
+    }
+};
+
+#endif
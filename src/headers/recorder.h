@@ -0,0 +1,77 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "camera.h"
+#include "light.h"
+#include "planet.h"
+#include "postprocess.h"
+
+const char RECORDING_MAGIC[4] = {'P', 'R', 'E', 'C'};
+const uint32_t RECORDING_VERSION = 2;
+
+// records the camera, light, cubesphere and planet parameters of every frame to a binary log, and plays it
+// back on a fixed virtual clock so replays are frame for frame identical
+//
+// log layout (little endian): magic, version, hash of the parameter names and sizes, then per frame
+// the camera state, the light state, the cubesphere segments, radius and projection, a postprocessing flag
+// and path, and only the parameters that changed since the previous frame as (index, raw value) pairs
+class Recorder {
+public:
+    Recorder();
+
+    bool start_recording(const std::string &path);
+    bool start_replay(const std::string &path);
+    void stop();
+
+    // the wall clock while live or recording, the virtual clock while replaying
+    float frame_time(float wall_time);
+
+    // write this frame's state to the log, or replace it with the next frame of the replay
+    void update(Camera &camera, Light &light, Planet &planet, bool &postprocessing, PostProcessPath &path);
+
+    bool is_recording();
+    bool is_replaying();
+    int get_frame();
+
+    float replay_dt = 1.0f / 60;
+    std::string status;
+
+private:
+    void record_frame(Camera &camera, Light &light, Planet &planet, bool postprocessing, PostProcessPath path);
+    bool replay_frame(Camera &camera, Light &light, Planet &planet, bool &postprocessing, PostProcessPath &path);
+
+    template <typename T>
+    void write(const T &value) {
+        out.write((const char *)&value, sizeof(T));
+    }
+
+    template <typename T>
+    bool read(T &value) {
+        if (cursor + sizeof(T) > data.size()) {
+            return false;
+        }
+        memcpy(&value, &data[cursor], sizeof(T));
+        cursor += sizeof(T);
+        return true;
+    }
+
+    // offset and size of every parameter inside PlanetParams, in visiting order
+    std::vector<std::pair<size_t, size_t>> layout;
+    uint64_t schema = 0;
+
+    enum { IDLE, RECORDING, REPLAYING } mode = IDLE;
+    std::ofstream out;
+    std::vector<char> data;
+    size_t cursor = 0;
+    PlanetParams previous;
+    int frame = 0;
+};
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef REFERENCE_RENDERER_H
+#define REFERENCE_RENDERER_H
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "planet_params.h"
+#include "thread_pool.h"
+
+class Planet;
+class Light;
+
+// rays are traced in 2x2 pixel quads, and pixels are handed to the threads in square tiles
+const int PACKET_SIZE = 4;
+const int REFERENCE_TILE_SIZE = 16;
+
+// the light as the shaders see it, plus the sphere the sun is drawn as
+struct ReferenceLight {
+    glm::vec3 position = glm::vec3(30, 0, 0);
+    glm::vec3 ambient = glm::vec3(0.2f, 0.2f, 0.2f);
+    glm::vec3 diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+    glm::vec3 specular = glm::vec3(1, 1, 1);
+    float radius = 0.5f;
+    glm::vec3 colour = glm::vec3(0.5f, 0.5f, 0.5f);
+};
+
+// four rays from the camera, one per pixel of a quad, stored lane by lane
+struct RayPacket {
+    glm::vec3 origin;
+    float dir_x[PACKET_SIZE], dir_y[PACKET_SIZE], dir_z[PACKET_SIZE];
+    float view_length[PACKET_SIZE]; // length of the unnormalised view vector, for the far plane depth
+};
+
+// cpu port of planet.vert, planet.frag and postprocess.glsl that needs no gl context
+// the terrain is ray marched against the displaced cube sphere instead of rasterised, everything after
+// that follows the shaders line by line, so an image from here is the golden image for the gpu path
+class ReferenceRenderer {
+public:
+    ReferenceRenderer(int num_threads = 0);
+
+    // copy the parameters of live gl objects (the renderer itself never touches gl)
+    void set_scene(Planet &planet, Light &light);
+
+    // load the terrain and water normal maps, returns false if either is missing
+    bool load_textures(const std::string &terrain_path = "data/textures/terrain_normal_map.jpg",
+                       const std::string &water_path = "data/textures/water_normal_map.png");
+
+    // render width x height pixels with the given camera, bottom row first like glReadPixels
+    // colours are linear and unclamped, to_rgba8 converts them the way the default framebuffer does
+    void render(Camera &camera, float time, int width, int height, std::vector<glm::vec4> &image);
+
+    static void to_rgba8(const std::vector<glm::vec4> &image, std::vector<unsigned char> &pixels);
+
+    PlanetParams params;
+    glm::vec3 planet_position = glm::vec3(0);
+    float planet_radius = 1; // radius the cube sphere was built with (and the radius uniform)
+    float planet_scale = 1; // uniform scale of the model matrix
+
+    ReferenceLight light;
+    glm::vec3 clear_colour = glm::vec3(0.1f, 0.1f, 0.1f);
+
+    bool postprocessing = true;
+    int samples = 1; // jittered samples per pixel
+    float step_scale = 1; // multiplier on the march step counts, like the accumulated frames
+
+    // wall time of the last render
+    float render_ms = 0;
+
+private:
+    struct Texture {
+        int width = 0, height = 0;
+        std::vector<unsigned char> texels; // rgb
+    };
+
+    // per-render state, the values the shaders get as uniforms
+    struct Frame {
+        glm::mat4 ip, iv;
+        glm::vec3 cam_pos;
+        glm::vec2 near_far;
+        glm::vec3 radii;
+        glm::vec3 rgb_scatter;
+        int num_inscatter_pts, num_od_pts, num_cloud_pts, num_cloud_light_pts;
+        float terrain_min, terrain_max; // bounds on the terrain radius in object space
+        float outer_radius; // nothing is drawn outside of this sphere except the sun
+        float time;
+        glm::vec2 jitter; // sample position within each pixel
+        float march_offset;
+    };
+
+    struct Hit {
+        float depth; // distance along the ray, far plane depth if nothing was hit
+        glm::vec4 colour;
+    };
+
+    void render_tile(const Frame &frame, int tile, int width, int height, std::vector<glm::vec4> &image);
+    void trace_packet(const Frame &frame, const RayPacket &packet, int mask, glm::vec4 *out);
+
+    // scene pass (planet.vert and planet.frag, and the sun)
+    Hit trace_scene(const Frame &frame, const glm::vec3 &origin, const glm::vec3 &dir, float view_length);
+    bool intersect_terrain(const Frame &frame, const glm::vec3 &origin, const glm::vec3 &dir, float &t);
+    glm::vec3 terrain_position(const glm::vec3 &cube_pos, float &local_ht);
+    glm::vec3 shade_terrain(const Frame &frame, const glm::vec3 &cube_pos);
+
+    // post-process pass (postprocess.glsl)
+    glm::vec4 postprocess(const Frame &frame, const glm::vec3 &dir, const Hit &hit);
+    float shade_ocean(const Frame &frame, const glm::vec3 &dir, float scene_depth, glm::vec4 &colour);
+    glm::vec3 integrate_scattering(const Frame &frame, const glm::vec3 &dir, glm::vec4 segments, glm::vec3 orig_colour);
+    float density_at_pt(const Frame &frame, const glm::vec3 &pt);
+    float optical_depth(const Frame &frame, glm::vec3 origin, const glm::vec3 &dir, float ray_length);
+    float fbm(const Frame &frame, const glm::vec3 &pos);
+    float cloud_density_at_pt(const Frame &frame, const glm::vec3 &pt);
+    float hg(float a);
+    float lightmarch(const Frame &frame, const glm::vec3 &pt, const glm::vec3 &light_dir);
+
+    glm::vec3 sample(const Texture &texture, glm::vec2 uv);
+    glm::vec3 triplanar_normal(const Texture &texture, const glm::vec3 &nn, const glm::vec3 &pos, glm::vec2 offsets);
+
+    ThreadPool pool;
+    Texture terrain_normal_map, water_normal_map;
+};
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "gl_handle.h"
+
+// frames a pooled texture is kept after it was last used, so a target that comes and goes (or a render scale
+// that is still settling) is not reallocated every time
+const int RENDER_GRAPH_POOL_FRAMES = 30;
+
+// bytes in each block the pass closures are copied into
+const size_t RENDER_GRAPH_CLOSURE_BLOCK = 4096;
+
+// one version of a resource, every write makes a new one
+typedef int RenderResource;
+
+struct TextureDesc {
+    int width, height;
+    int depth; // more than 1 for a 3d texture
+    GLenum format;
+};
+
+// what an attachment holds when its pass starts; transient targets are cleared on their first write either way,
+// since whatever is left in a pooled texture is garbage
+enum LoadOp {
+    LOAD,
+    CLEAR,
+    DONT_CARE
+};
+
+// the frame as passes declaring what they read and write, built again every frame and then run in dependency
+// order; passes nothing depends on are culled, transient textures come from a pool and share memory with
+// others whose lifetimes do not overlap, and framebuffers, viewports and clears are set up for each pass;
+// everything the declaration needs is kept from frame to frame, so a frame like the last one never allocates
+class RenderGraph {
+public:
+    class Pass {
+    public:
+        // draw into r (a colour or depth attachment, by its format), returns the version written
+        RenderResource attach(RenderResource r, LoadOp load = LOAD, glm::vec4 clear = glm::vec4(0));
+        // sample r
+        void read(RenderResource r);
+        // write r some other way (image stores, blits), returns the version written
+        RenderResource write(RenderResource r);
+        // never cull this pass, it has effects outside the graph (a readback)
+        void keep();
+
+    private:
+        friend class RenderGraph;
+
+        struct Attachment {
+            RenderResource from, version;
+            LoadOp load;
+            glm::vec4 clear;
+        };
+
+        RenderResource new_version(RenderResource r);
+
+        RenderGraph *graph;
+        int index;
+        const char *name;
+        void *closure;
+        void (*call)(void *closure);
+        std::vector<Attachment> attachments;
+        std::vector<RenderResource> reads, inputs, outputs;
+        bool kept = false;
+    };
+
+    RenderGraph() {}
+
+    RenderGraph(const RenderGraph &) = delete;
+    RenderGraph &operator=(const RenderGraph &) = delete;
+
+    // start declaring a frame for a window of this size, target stands in for the window's framebuffer
+    // when rendering offscreen (its colour attachment is what the backbuffer passes draw into)
+    void begin(int width, int height, unsigned int target = 0);
+
+    // the window's colour and depth buffers
+    RenderResource backbuffer();
+    RenderResource backbuffer_depth();
+
+    // a texture that only lives for this frame
+    RenderResource create_texture(const char *name, const TextureDesc &desc);
+    // a texture owned elsewhere that outlives the frame, passes writing it are never culled
+    RenderResource import_texture(const char *name, unsigned int texture, const TextureDesc &desc);
+
+    // execute runs when the graph does, after everything it depends on (names must be string literals); it is
+    // copied into the graph's own memory and never destroyed, so it can only capture references and plain values
+    template <typename F>
+    Pass &add_pass(const char *name, const F &execute) {
+        static_assert(std::is_trivially_destructible<F>::value, "pass closures are never destroyed");
+        static_assert(sizeof(F) <= RENDER_GRAPH_CLOSURE_BLOCK, "pass closure is too big");
+        Pass &pass = new_pass(name);
+        pass.closure = new (closure_memory(sizeof(F), alignof(F))) F(execute);
+        pass.call = [](void *closure) { (*(F *)closure)(); };
+        return pass;
+    }
+
+    // order, cull, allocate and run the passes, and leave the window's framebuffer (or target) bound
+    void execute();
+
+    // while running, the texture behind r and a framebuffer with it attached (to blit or read from)
+    unsigned int texture(RenderResource r);
+    unsigned int read_framebuffer(RenderResource r);
+    glm::ivec2 size(RenderResource r);
+
+    // free every pooled texture now, rather than when the graph goes
+    void release();
+
+    // what the last frame ran, and what the pool holds
+    int passes = 0, culled = 0;
+    int pooled_textures = 0;
+    size_t pooled_bytes = 0;
+    std::vector<const char *> order;
+
+private:
+    struct Resource {
+        const char *name;
+        TextureDesc desc;
+        bool imported, is_backbuffer;
+        unsigned int texture;
+        int pool = -1;
+        int latest; // newest version
+        int first_use, last_use; // in execution order
+    };
+
+    struct Version {
+        int resource;
+        int producer; // the pass that wrote it, -1 if it existed before the frame
+    };
+
+    struct PooledTexture {
+        TextureDesc desc;
+        GlTexture texture;
+        long long last_used;
+        bool busy;
+        TrackedBytes tracked;
+    };
+
+    RenderResource add_resource(const char *name, const TextureDesc &desc, bool imported, bool is_backbuffer, unsigned int texture);
+    Pass &new_pass(const char *name);
+    void *closure_memory(size_t size, size_t align);
+    void schedule();
+    void allocate(Resource &resource);
+    void run(Pass &pass);
+    unsigned int framebuffer(const std::vector<unsigned int> &textures, const std::vector<bool> &depth);
+    void trim();
+
+    static bool is_depth(GLenum format);
+    static size_t texel_size(GLenum format);
+
+    // passes (with their lists) are reused by later frames, only the first pass_count are this frame's
+    std::deque<Pass> pass_list;
+    int pass_count = 0;
+    std::vector<Resource> resources;
+    std::vector<Version> versions;
+
+    std::vector<std::unique_ptr<char[]>> closure_blocks;
+    size_t closure_block = 0, closure_offset = 0;
+
+    // scratch space for scheduling and running, kept so their capacity is too
+    std::vector<bool> needed;
+    std::vector<int> stack, waiting, ready, ordered;
+    std::vector<std::vector<int>> after;
+    std::vector<unsigned int> attached, read_attached;
+    std::vector<bool> attached_depth, read_attached_depth;
+    RenderResource window_colour = -1, window_depth = -1;
+    int window_width = 0, window_height = 0;
+    unsigned int window_framebuffer = 0;
+
+    std::vector<PooledTexture> pool;
+    std::map<std::vector<unsigned int>, GlFramebuffer> framebuffers;
+    long long frame = 0;
+};
+
+#endif
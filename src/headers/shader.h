@@ -8,6 +8,11 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <vector>
+
+#include "artifact_cache.h"
+#include "gl_handle.h"
+#include "gl_state.h"
 
 class Shader {
 public:
@@ -17,34 +22,16 @@ public:
         build_shader(vertex_path, fragment_path);
     }
 
-    void build_shader(const char *vertex_path, const char *fragment_path) {
-        std::string vertex_code;
-        std::string fragment_code;
-
-        std::ifstream v_shader_file;
-        std::ifstream f_shader_file;
-
-        v_shader_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        f_shader_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-
-        try {
-            v_shader_file.open(vertex_path);
-            f_shader_file.open(fragment_path);
-
-            std::stringstream v_shader_stream, f_shader_stream;
-            v_shader_stream << v_shader_file.rdbuf();
-            f_shader_stream << f_shader_file.rdbuf();
+    void build_shader(const char *vertex_path, const char *fragment_path, const std::string &defines = "") {
+        uniforms.clear();
+        std::string vertex_code = read_source(vertex_path, defines);
+        std::string fragment_code = read_source(fragment_path, defines);
 
-            v_shader_file.close();
-            f_shader_file.close();
-
-            vertex_code = v_shader_stream.str();
-            fragment_code = f_shader_stream.str();
-        } catch (const std::ifstream::failure &e) {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
-            std::cout << vertex_path << " " << fragment_path << std::endl;
-            std::cout << e.what() << std::endl;
+        CacheKey key = program_key(vertex_code, fragment_code);
+        if (load_program(key)) {
+            return;
         }
+
         const char *v_shader_code = vertex_code.c_str();
         const char *f_shader_code = fragment_code.c_str();
 
@@ -73,15 +60,18 @@ public:
         }
 
         // link shaders to a program
-        ID = glCreateProgram();
+        ID = GlProgram::generate();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
+        glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(ID);
 
         glGetProgramiv(ID, GL_LINK_STATUS, &success);
         if (!success) {
             glGetProgramInfoLog(ID, 512, NULL, infolog);
             std::cout << "Failed to link shaders - " << infolog << std::endl;
+        } else {
+            save_program(key);
         }
 
         // delete the shaders, since we don't need them anymore after we linked them
@@ -89,56 +79,197 @@ public:
         glDeleteShader(fragment);
     }
 
+    void build_compute(const char *compute_path, const std::string &defines = "") {
+        uniforms.clear();
+        std::string compute_code = read_source(compute_path, defines);
+        const char *c_shader_code = compute_code.c_str();
+
+        CacheKey key = program_key(compute_code);
+        if (load_program(key)) {
+            return;
+        }
+
+        unsigned int compute;
+        int success;
+        char infolog[512];
+
+        compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, 1, &c_shader_code, NULL);
+        glCompileShader(compute);
+        glGetShaderiv(compute, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(compute, 512, NULL, infolog);
+            std::cout << "Compute shader compilation failed @ " << compute_path << " - " << infolog << std::endl;
+        }
+
+        ID = GlProgram::generate();
+        glAttachShader(ID, compute);
+        glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(ID);
+
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (!success) {
+            glGetProgramInfoLog(ID, 512, NULL, infolog);
+            std::cout << "Failed to link compute shader - " << infolog << std::endl;
+        } else {
+            save_program(key);
+        }
+
+        glDeleteShader(compute);
+    }
+
     void use() {
-        glUseProgram(ID);
+        GlState::get().use_program(ID);
     }
 
-    void set_bool(const std::string& name, bool value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    // uniform names must be string literals, their locations are looked up once and kept by pointer
+    void set_bool(const char *name, bool value) const {
+        glUniform1i(location(name), value);
     }
 
-    void set_int(const std::string &name, int value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    void set_int(const char *name, int value) const {
+        glUniform1i(location(name), value);
     }
 
-    void set_float(const std::string &name, float value) const {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    void set_float(const char *name, float value) const {
+        glUniform1f(location(name), value);
     }
 
-    void set_vector2(const std::string &name, const glm::vec2 &value) const {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    void set_vector2(const char *name, const glm::vec2 &value) const {
+        glUniform2fv(location(name), 1, &value[0]);
     }
 
-    void set_vector2(const std::string &name, float x, float y) const {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+    void set_vector2(const char *name, float x, float y) const {
+        glUniform2f(location(name), x, y);
     }
 
-    void set_vector3(const std::string &name, const glm::vec3 &value) const {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    void set_vector3(const char *name, const glm::vec3 &value) const {
+        glUniform3fv(location(name), 1, &value[0]);
     }
 
-    void set_vector3(const std::string &name, float x, float y, float z) const {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+    void set_vector3(const char *name, float x, float y, float z) const {
+        glUniform3f(location(name), x, y, z);
     }
 
-    void set_vector4(const std::string &name, const glm::vec4 &value) const {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    void set_vector4(const char *name, const glm::vec4 &value) const {
+        glUniform4fv(location(name), 1, &value[0]);
     }
 
-    void set_vector4(const std::string &name, float x, float y, float z, float w) const {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+    void set_vector4(const char *name, float x, float y, float z, float w) const {
+        glUniform4f(location(name), x, y, z, w);
     }
 
-    void set_matrix3(const std::string &name, const glm::mat3 &mat) const {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    void set_matrix3(const char *name, const glm::mat3 &mat) const {
+        glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
 
-    void set_matrix4(const std::string &name, const glm::mat4 &mat) const {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    void set_matrix4(const char *name, const glm::mat4 &mat) const {
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
-    unsigned int ID;
+    struct Uniform {
+        const char *name;
+        int location;
+    };
+
+    int location(const char *name) const {
+        for (const Uniform &uniform : uniforms) {
+            if (uniform.name == name) {
+                return uniform.location;
+            }
+        }
+        int location = glGetUniformLocation(ID, name);
+        uniforms.push_back({name, location});
+        return location;
+    }
+
+    // linked programs are cached as driver binaries, keyed on the full source and on the driver that built them
+    static CacheKey program_key(const std::string &first_code, const std::string &second_code = "") {
+        CacheKey key("program");
+        key.add(first_code).add(second_code);
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+            const char *value = (const char *)glGetString(name);
+            key.add(std::string(value ? value : ""));
+        }
+        return key;
+    }
+
+    // a driver without binary formats never gets a hit, and a binary the driver rejects is rebuilt from source
+    bool load_program(const CacheKey &key) {
+        int formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        if (formats == 0) {
+            return false;
+        }
+        std::shared_ptr<const Artifact> binary = ArtifactCache::get().find(key);
+        if (!binary || binary->size() <= sizeof(GLenum)) {
+            return false;
+        }
+
+        int success;
+        ID = GlProgram::generate();
+        glProgramBinary(ID, *(const GLenum *)binary->data(), binary->data() + sizeof(GLenum), (GLsizei)(binary->size() - sizeof(GLenum)));
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (!success) {
+            ID.reset();
+            return false;
+        }
+        return true;
+    }
+
+    void save_program(const CacheKey &key) {
+        int length = 0;
+        glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            return;
+        }
+        GLenum format;
+        std::vector<char> binary(length);
+        glGetProgramBinary(ID, length, NULL, &format, binary.data());
+        ArtifactCache::get().store(key, {{&format, sizeof(format)}, {binary.data(), binary.size()}});
+    }
+
+    // read a shader file, splicing in #include "file" lines (relative to the including file)
+    // and inserting the defines straight after the #version line
+    static std::string read_source(const std::string &path, const std::string &defines = "") {
+        std::ifstream shader_file;
+        shader_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+
+        std::stringstream shader_stream;
+        try {
+            shader_file.open(path);
+            shader_stream << shader_file.rdbuf();
+            shader_file.close();
+        } catch (const std::ifstream::failure &e) {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
+            std::cout << path << std::endl;
+            std::cout << e.what() << std::endl;
+            return "";
+        }
+
+        std::string dir = path.substr(0, path.find_last_of("/\\") + 1);
+        std::string source, line;
+        bool first = true;
+        while (std::getline(shader_stream, line)) {
+            if (line.rfind("#include", 0) == 0) {
+                size_t start = line.find('"') + 1;
+                source += read_source(dir + line.substr(start, line.find_last_of('"') - start));
+            } else {
+                source += line + "\n";
+            }
+            if (first && !defines.empty()) {
+                source += defines;
+            }
+            first = false;
+        }
+        return source;
+    }
+
+    // building again replaces (and deletes) the program built before
+    GlProgram ID;
+
+    mutable std::vector<Uniform> uniforms;
 };
 
 #endif
\ No newline at end of file
@@ -5,6 +5,7 @@
 
 #include <vector>
 
+#include "gl_handle.h"
 #include "shader.h"
 
 class Sphere {
@@ -26,6 +27,8 @@ public:
     int get_verts();
     bool get_project();
     float get_radius();
+    // the radius given to set_radius, which only scales the model
+    float get_scale();
     int get_segments();
 
     glm::vec3 position = glm::vec3(0);
@@ -35,13 +38,16 @@ protected:
     float radius;
     int total_indices = 0;
 
-    unsigned int vao, vbo, ebo;
+    // owned, so rebuilding or destroying the sphere frees them
+    GlVertexArray vao;
+    GlStreamBuffer vbo = GlStreamBuffer(MEMORY_MESH), ebo = GlStreamBuffer(MEMORY_MESH);
 
     glm::mat4 model = glm::mat4(1);
     glm::mat3 tinv_model = glm::mat3(1);
 
 private:
     void build_vertices();
+    void generate_mesh();
 
     void add_vertex(glm::vec3 point);
     void add_triangle(int i1, int i2, int i3);
@@ -52,7 +58,6 @@ private:
     glm::vec3 colour = glm::vec3(0.5f, 0.5f, 0.5f);
 
     std::vector<float> vertices;
-    std::vector<float> normals;
     std::vector<unsigned int> indices;
 
     Shader sphere_shader = Shader("data/shaders/sphere.vert", "data/shaders/sphere.frag");
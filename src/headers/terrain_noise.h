@@ -0,0 +1,156 @@
+#ifndef TERRAIN_NOISE_H
+#define TERRAIN_NOISE_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#include "planet_params.h"
+
+// cpu port of terrain.glsl, for everything that evaluates the terrain without the gpu
+
+// noise functions from https://github.com/ashima/webgl-noise (as in the shaders)
+inline glm::vec3 mod289(glm::vec3 x) {
+    return x - glm::floor(x * (1.0f / 289.0f)) * 289.0f;
+}
+
+inline glm::vec4 mod289(glm::vec4 x) {
+    return x - glm::floor(x * (1.0f / 289.0f)) * 289.0f;
+}
+
+inline glm::vec4 permute(glm::vec4 x) {
+    return mod289(((x * 34.0f) + 10.0f) * x);
+}
+
+inline glm::vec4 taylor_inv_sqrt(glm::vec4 r) {
+    return 1.79284291400159f - 0.85373472095314f * r;
+}
+
+inline float snoise(glm::vec3 v) {
+    const glm::vec2 C = glm::vec2(1.0f / 6.0f, 1.0f / 3.0f);
+    const glm::vec4 D = glm::vec4(0.0f, 0.5f, 1.0f, 2.0f);
+
+    // first corner
+    glm::vec3 i = glm::floor(v + glm::dot(v, glm::vec3(C.y)));
+    glm::vec3 x0 = v - i + glm::dot(i, glm::vec3(C.x));
+
+    // other corners
+    glm::vec3 g = glm::step(glm::vec3(x0.y, x0.z, x0.x), x0);
+    glm::vec3 l = 1.0f - g;
+    glm::vec3 i1 = glm::min(g, glm::vec3(l.z, l.x, l.y));
+    glm::vec3 i2 = glm::max(g, glm::vec3(l.z, l.x, l.y));
+
+    glm::vec3 x1 = x0 - i1 + C.x;
+    glm::vec3 x2 = x0 - i2 + C.y;
+    glm::vec3 x3 = x0 - D.y;
+
+    // permutations
+    i = mod289(i);
+    glm::vec4 p = permute(permute(permute(
+                  i.z + glm::vec4(0.0f, i1.z, i2.z, 1.0f))
+                + i.y + glm::vec4(0.0f, i1.y, i2.y, 1.0f))
+                + i.x + glm::vec4(0.0f, i1.x, i2.x, 1.0f));
+
+    // gradients, 7x7 points over a square mapped onto an octahedron
+    float n_ = 0.142857142857f;
+    glm::vec3 ns = n_ * glm::vec3(D.w, D.y, D.z) - glm::vec3(D.x, D.z, D.x);
+
+    glm::vec4 j = p - 49.0f * glm::floor(p * ns.z * ns.z);
+
+    glm::vec4 x_ = glm::floor(j * ns.z);
+    glm::vec4 y_ = glm::floor(j - 7.0f * x_);
+
+    glm::vec4 x = x_ * ns.x + ns.y;
+    glm::vec4 y = y_ * ns.x + ns.y;
+    glm::vec4 h = 1.0f - glm::abs(x) - glm::abs(y);
+
+    glm::vec4 b0 = glm::vec4(x.x, x.y, y.x, y.y);
+    glm::vec4 b1 = glm::vec4(x.z, x.w, y.z, y.w);
+
+    glm::vec4 s0 = glm::floor(b0) * 2.0f + 1.0f;
+    glm::vec4 s1 = glm::floor(b1) * 2.0f + 1.0f;
+    glm::vec4 sh = -glm::step(h, glm::vec4(0.0f));
+
+    glm::vec4 a0 = glm::vec4(b0.x, b0.z, b0.y, b0.w) + glm::vec4(s0.x, s0.z, s0.y, s0.w) * glm::vec4(sh.x, sh.x, sh.y, sh.y);
+    glm::vec4 a1 = glm::vec4(b1.x, b1.z, b1.y, b1.w) + glm::vec4(s1.x, s1.z, s1.y, s1.w) * glm::vec4(sh.z, sh.z, sh.w, sh.w);
+
+    glm::vec3 p0 = glm::vec3(a0.x, a0.y, h.x);
+    glm::vec3 p1 = glm::vec3(a0.z, a0.w, h.y);
+    glm::vec3 p2 = glm::vec3(a1.x, a1.y, h.z);
+    glm::vec3 p3 = glm::vec3(a1.z, a1.w, h.w);
+
+    // normalise gradients
+    glm::vec4 norm = taylor_inv_sqrt(glm::vec4(glm::dot(p0, p0), glm::dot(p1, p1), glm::dot(p2, p2), glm::dot(p3, p3)));
+    p0 *= norm.x;
+    p1 *= norm.y;
+    p2 *= norm.z;
+    p3 *= norm.w;
+
+    // mix final noise value
+    glm::vec4 m = glm::max(0.5f - glm::vec4(glm::dot(x0, x0), glm::dot(x1, x1), glm::dot(x2, x2), glm::dot(x3, x3)), 0.0f);
+    m = m * m;
+    return 105.0f * glm::dot(m * m, glm::vec4(glm::dot(p0, x0), glm::dot(p1, x1), glm::dot(p2, x2), glm::dot(p3, x3)));
+}
+
+inline float smooth_max(float a, float b, float k) {
+    k = std::min(0.0f, -k);
+    float h = std::max(0.0f, std::min(1.0f, (b - a + k) / (2.0f * k)));
+    return a * h + b * (1.0f - h) - k * h * (1.0f - h);
+}
+
+// fractal noise at a point on the cube, from -1 to 1
+// extra_octaves carries the series on past params.octaves for detail finer than the mesh, without changing
+// the scale of the octaves before them, so coarse and detailed samples of the same point agree
+inline float terrain_noise(const PlanetParams &params, const glm::vec3 &pos, int extra_octaves = 0) {
+    float frequency = params.noise_params.x;
+    float persistence = params.noise_params.y;
+    float lacunarity = params.noise_params.z;
+
+    float nsum = 0.0f;
+    float amplitude = 1.0f;
+    float total_amp = 0.0f;
+    for (int i = 0; i < params.octaves + extra_octaves; i++) {
+        nsum += snoise(pos * frequency + params.offset) * amplitude;
+        if (i < params.octaves) {
+            total_amp += amplitude;
+        }
+        amplitude *= persistence;
+        frequency *= lacunarity;
+    }
+    return total_amp > 0.0f ? nsum / total_amp : 0.0f;
+}
+
+// height above the sphere for a raw noise value, with the ocean floor flattened and deepened
+inline float terrain_height(const PlanetParams &params, float local_ht) {
+    float new_height = local_ht * params.noise_mult;
+    float ocean_depth = params.ocean_params.x;
+    float ocean_smooth = params.ocean_params.y;
+    float ocean_mult = params.ocean_params.z;
+    new_height = smooth_max(new_height, -(ocean_depth * params.noise_mult), ocean_smooth);
+    if (new_height < 0.0f) {
+        new_height *= ocean_mult;
+    }
+    return new_height;
+}
+
+// displace a point on the cube of a sphere with the given radius onto the terrain
+inline glm::vec3 terrain_point(const PlanetParams &params, float radius, const glm::vec3 &pos, float &local_ht, int extra_octaves = 0) {
+    local_ht = terrain_noise(params, pos, extra_octaves);
+    return glm::normalize(pos) * (radius + terrain_height(params, local_ht));
+}
+
+// terrain normal at a point on the cube, from two more samples delta along the tangent and bitangent
+inline glm::vec3 terrain_normal(const PlanetParams &params, float radius, const glm::vec3 &pos, const glm::vec3 &displaced, float delta, int extra_octaves = 0) {
+    glm::vec3 sphere_normal = glm::normalize(pos);
+    float phi = atan2f(pos.z, pos.x);
+    glm::vec3 tangent = glm::vec3(-sinf(phi), 0.0f, cosf(phi));
+    glm::vec3 bitangent = glm::cross(sphere_normal, tangent);
+
+    float ht;
+    glm::vec3 tangent_sample = terrain_point(params, radius, pos + delta * glm::normalize(tangent), ht, extra_octaves);
+    glm::vec3 bitangent_sample = terrain_point(params, radius, pos + delta * glm::normalize(bitangent), ht, extra_octaves);
+    return glm::normalize(glm::cross(tangent_sample - displaced, bitangent_sample - displaced));
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef TEXTURE_FILE_H
+#define TEXTURE_FILE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "artifact_cache.h"
+
+// normal maps ship as KTX 1.1 files holding their whole mip chain compressed to RGTC2 (BC5): x and y in two
+// block compressed channels at a byte per texel, z is rebuilt in the shaders
+// the file is mapped and each level goes to the driver as it is, so nothing is decoded at startup
+
+// the compressed file that goes with a source image, the same name with a .ktx extension
+std::string compressed_texture_path(const std::string &image_path);
+
+// compress an 8-bit normal map of 3 or 4 channels with a box filtered, renormalised mip chain
+bool write_normal_map(const std::string &path, const unsigned char *pixels, int width, int height, int channels);
+
+// a texture read into memory and ready to upload, either every level of a compressed file or the pixels of
+// a decoded image, whose mipmaps are then left to the driver
+struct TextureData {
+    struct Level {
+        int width, height;
+        size_t offset, size; // into source
+        size_t row_size; // bytes per row of texels, or of blocks when compressed
+        int rows;
+    };
+
+    std::shared_ptr<const Artifact> source;
+    unsigned int internal_format = 0;
+    unsigned int format = 0, type = 0; // 0 when compressed
+    std::vector<Level> levels;
+    bool generate_mipmaps = false;
+
+    bool is_compressed() const {
+        return type == 0;
+    }
+
+    // levels the texture needs storage for, including the ones the driver makes
+    int storage_levels() const;
+};
+
+// read the compressed file next to image_path, or the image itself when there isn't one; only touches
+// memory, so it is safe on any thread
+bool read_texture(const std::string &image_path, TextureData &data);
+
+#endif
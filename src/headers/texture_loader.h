@@ -0,0 +1,79 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "gl_handle.h"
+#include "memory_tracker.h"
+#include "texture_file.h"
+#include "thread_pool.h"
+
+// a texture that shows a 1x1 placeholder until its file has been read and uploaded
+struct StreamedTexture {
+    GlTexture id; // bind this every time, it changes once the real texture is in
+    bool ready = false;
+    std::string path;
+
+    TrackedBytes tracked = TrackedBytes(MEMORY_TEXTURE);
+};
+
+// loads textures without holding up the frame: files are read (mapped, or decoded) on worker threads, and
+// the gl thread streams them into their textures through a pixel buffer object, a few chunks per frame
+class TextureLoader {
+public:
+    static TextureLoader &get();
+
+    // a repeating, trilinear filtered texture for image_path (or the compressed file next to it), showing
+    // placeholder in the meantime; call on the gl thread
+    std::shared_ptr<StreamedTexture> load(const std::string &image_path, glm::u8vec4 placeholder);
+
+    // upload chunks of whatever has been read until about budget_ms has gone, once per frame on the gl thread
+    void update();
+
+    // read and upload everything still pending, for tools that want every texture in their first frame
+    void finish();
+
+    int pending();
+
+    float budget_ms = 2;
+    size_t chunk_size = 1 << 20;
+
+    int loaded = 0;
+    size_t uploaded_bytes = 0;
+
+private:
+    TextureLoader() {}
+
+    struct Job {
+        std::shared_ptr<StreamedTexture> texture;
+        TextureData data;
+        bool failed = false;
+
+        // where the upload is up to
+        GlTexture id;
+        int level = 0;
+        int row = 0;
+    };
+
+    // upload the next chunk of the front job, true when that finished it
+    bool upload_chunk(Job &job);
+    void complete(Job &job);
+
+    std::unique_ptr<ThreadPool> readers;
+    GlBuffer pbo;
+    TrackedBytes pbo_bytes = TrackedBytes(MEMORY_BUFFER);
+
+    std::mutex mutex;
+    std::deque<std::shared_ptr<Job>> ready; // read by a worker, waiting for the gl thread
+    std::deque<std::shared_ptr<Job>> uploading; // gl thread only
+    std::atomic<int> outstanding{0};
+};
+
+#endif
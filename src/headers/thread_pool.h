@@ -0,0 +1,140 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads, each with its own queue of tasks
+// a worker takes tasks from the back of its own queue and steals from the front of the others once it
+// runs dry, so uneven tasks (tiles of sky next to tiles of clouds) still keep every thread busy
+class ThreadPool {
+public:
+    // 0 threads uses one per hardware thread
+    ThreadPool(int num_threads = 0) {
+        if (num_threads <= 0) {
+            num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+        }
+        for (int i = 0; i < num_threads; i++) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        for (int i = 0; i < num_threads; i++) {
+            threads.emplace_back(&ThreadPool::work, this, i);
+        }
+    }
+
+    ~ThreadPool() {
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // queue a task and return straight away, the tasks are dealt out round-robin
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Queue &queue = *queues[next++ % queues.size()];
+            std::lock_guard<std::mutex> queue_lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+            queued++;
+            pending++;
+        }
+        wake.notify_one();
+    }
+
+    // block until at most max_pending tasks are queued or running
+    void wait(int max_pending = 0) {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&] { return pending <= max_pending; });
+    }
+
+    // run job(i) for every i in [0, count) and wait for all of them to finish
+    void parallel_for(int count, const std::function<void(int)> &job) {
+        for (int i = 0; i < count; i++) {
+            submit([&job, i] { job(i); });
+        }
+        wait();
+    }
+
+    int size() {
+        return (int)threads.size();
+    }
+
+    int get_pending() {
+        return pending;
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void work(int id) {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || queued > 0; });
+                if (stopping) {
+                    return;
+                }
+            }
+
+            std::function<void()> task;
+            while (pop(id, task)) {
+                task();
+                task = nullptr;
+                std::lock_guard<std::mutex> lock(mutex);
+                pending--;
+                done.notify_all();
+            }
+        }
+    }
+
+    // newest task of our own queue, otherwise the oldest task of the first other queue that has one
+    bool pop(int id, std::function<void()> &task) {
+        for (size_t i = 0; i < queues.size(); i++) {
+            Queue &queue = *queues[(id + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty()) {
+                if (i == 0) {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                } else {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                queued--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    std::atomic<int> queued{0}; // submitted and not yet taken by a worker
+    std::atomic<int> pending{0}; // submitted and not yet finished
+    size_t next = 0;
+    bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef VIRTUAL_TERRAIN_H
+#define VIRTUAL_TERRAIN_H
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "artifact_cache.h"
+#include "camera.h"
+#include "gl_handle.h"
+#include "planet_params.h"
+#include "shader.h"
+#include "thread_pool.h"
+
+// texels along a tile, plus a border of one on each side so tiles filter without reaching into their neighbours
+const int VT_TILE_SIZE = 64;
+const int VT_TILE_BORDER = 1;
+const int VT_TILE_STRIDE = VT_TILE_SIZE + 2 * VT_TILE_BORDER;
+
+// the gpu tile cache is a square atlas of tiles, the page table hashes tile keys to atlas slots
+const int VT_ATLAS_TILES = 16;
+const int VT_SLOTS = VT_ATLAS_TILES * VT_ATLAS_TILES;
+const int VT_PAGE_TABLE_SIZE = 1024;
+const int VT_PAGE_TABLE_BINDING = 4;
+
+// 16 bits per tile coordinate in the key, and about what float texture coordinates can still resolve
+const int VT_MAX_LEVEL = 16;
+
+// level at which the texels get finer than the last octave of the planet's noise, deeper levels add an octave each
+const int VT_DETAIL_LEVEL = 4;
+
+struct TileId {
+    int face, level, x, y;
+
+    // the low word holds x and y, the high word the face and level, as the page table stores them
+    uint64_t key() const {
+        return (uint64_t)((uint32_t)x | (uint32_t)y << 16) | (uint64_t)(face | level << 3) << 32;
+    }
+};
+
+// face (0 to 5, in gl cubemap order) and coordinates in [0, 1] of the face a direction points at
+int cube_face_uv(const glm::vec3 &dir, glm::vec2 &uv);
+glm::vec3 cube_face_direction(int face, glm::vec2 uv);
+
+// the terrain as a pyramid of tiles over the six cube faces (normal and raw noise height per texel, like the
+// baked cubemap), deep enough for detail far below anything a single texture or the mesh can hold
+// the camera decides which tiles are wanted every frame, tiles already on disk are mapped through the artifact
+// cache and uploaded into a fixed atlas on the gpu, missing ones are generated with the cpu noise on a
+// background thread and stored for next time; the atlas, the page table and the cache all have fixed sizes,
+// so resident memory stays the same however deep the pyramid goes
+class VirtualTerrain {
+public:
+    VirtualTerrain() {}
+    ~VirtualTerrain();
+
+    VirtualTerrain(const VirtualTerrain &) = delete;
+    VirtualTerrain &operator=(const VirtualTerrain &) = delete;
+
+    // request the tiles the camera needs for a planet of the given radius, position and scale, and upload
+    // whatever has become available since the last frame
+    void update(const PlanetParams &params, float radius, const glm::vec3 &planet_pos, float planet_scale, Camera &camera, int viewport_height);
+
+    // bind the atlas to a texture unit and the page table to its storage buffer, for virtual_terrain.glsl
+    void bind(Shader &shader, int texture_unit, int segments);
+
+    // free the gpu resources and forget every tile (after waiting for the generator)
+    void release();
+
+    int max_level = 12;
+    int uploads_per_frame = 16;
+
+    // tiles the camera asked for this frame, resident on the gpu, being generated, and generated so far
+    int wanted = 0;
+    int resident = 0;
+    int generating = 0;
+    std::atomic<int> generated{0};
+    // tiles uploaded so far, the terrain drawn changes with every one
+    int uploads = 0;
+    size_t gpu_bytes();
+
+private:
+    struct Slot {
+        uint64_t key = 0;
+        bool filled = false;
+        long long last_used = -1;
+    };
+
+    struct Ready {
+        uint64_t key;
+        uint64_t params_hash;
+        std::shared_ptr<const Artifact> tile;
+    };
+
+    void create_resources();
+    void select_tiles(float radius, const glm::vec3 &camera_pos, float focal, std::vector<TileId> &tiles);
+    static CacheKey tile_key(uint64_t params_hash, uint64_t key);
+    static std::vector<uint16_t> generate(const TileId &tile, const PlanetParams &params, float radius);
+    bool upload(uint64_t key, const Artifact &tile);
+    void write_page_table();
+
+    GlTexture atlas;
+    GlBuffer page_table;
+    TrackedBytes atlas_bytes = TrackedBytes(MEMORY_TEXTURE), page_table_bytes = TrackedBytes(MEMORY_BUFFER);
+
+    Slot slots[VT_SLOTS];
+    std::unordered_map<uint64_t, int> slot_of;
+    std::unordered_set<uint64_t> requested;
+    // roots of the previous terrain, drawn until their replacements arrive from the generator
+    std::unordered_set<uint64_t> stale;
+    bool table_dirty = false;
+    long long frame = 0;
+
+    uint64_t params_hash = 0;
+    std::atomic<uint64_t> current_hash{0}; // for the generator, to skip tiles of a terrain that has since changed
+
+    // generated tiles wait here until the gl thread uploads them
+    std::mutex ready_mutex;
+    std::vector<Ready> ready;
+
+    std::unique_ptr<ThreadPool> generator;
+};
+
+#endif
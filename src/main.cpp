@@ -8,20 +8,31 @@
 #include <imgui_impl_opengl3.h>
 
 #include <iostream>
+#include <string>
 
-#include "stb_image.h"
-
+#include "alloc_tracker.h"
 #include "camera.h"
 #include "editor.h"
+#include "frame_capture.h"
+#include "gl_state.h"
+#include "governor.h"
 #include "light.h"
+#include "memory_tracker.h"
 #include "planet.h"
+#include "postprocess.h"
+#include "profiler.h"
+#include "recorder.h"
+#include "render_graph.h"
 #include "sphere.h"
+#include "texture_loader.h"
 
 #include <glm/gtx/string_cast.hpp>
 
 const int SCR_WIDTH = 1600;
 const int SCR_HEIGHT = 900;
-const float ASPECT_RATIO = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+
+// current size of the window's framebuffer
+int fb_width = SCR_WIDTH, fb_height = SCR_HEIGHT;
 
 // create a camera
 Camera camera(glm::vec3(0, 0, 10), glm::vec3(0, 1, 0), glm::vec3(0, 0, -1));
@@ -44,8 +55,12 @@ bool moving = false;
 void process_input(GLFWwindow *window);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoff, double yoff);
+void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 
-int main() {
+// close off the per-frame allocation, gl state and profiler counters
+void end_frame();
+
+int main(int argc, char **argv) {
     // glfw/opengl setup
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -73,99 +88,22 @@ int main() {
     ImGui::StyleColorsDark();
 
     // create the window and capture inputs
-    glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+    glfwGetFramebufferSize(window, &fb_width, &fb_height);
+    glViewport(0, 0, fb_width, fb_height);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
     // enable some rendering options
-    glEnable(GL_PROGRAM_POINT_SIZE);
-    glEnable(GL_DEPTH_TEST);
+    GlState::get().enable(GL_PROGRAM_POINT_SIZE);
+    GlState::get().enable(GL_DEPTH_TEST);
     // glEnable(GL_CULL_FACE);
 
-    // create a framebuffer for the post processing effects
-    unsigned int framebuffer;
-    glGenFramebuffers(1, &framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-
-    // generate a texture to which we would render the scene to
-    unsigned int texColourBuffer;
-    glGenTextures(1, &texColourBuffer);
-    // glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texColourBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    // attach the texture to the framebuffer
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texColourBuffer, 0);
-
-    // create a depth texture
-    unsigned int texDepthBuffer;
-    glGenTextures(1, &texDepthBuffer);
-    // glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, texDepthBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, SCR_WIDTH, SCR_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    // attach depth texture to framebuffer
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texDepthBuffer, 0);
-
-    // check to make sure framebuffer is ok
-    auto fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-    if (fboStatus != GL_FRAMEBUFFER_COMPLETE) {
-        std::cout << "Framebuffer is not complete: " << fboStatus << std::endl;
-    }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // load the quad on which we will render the texture on
-    float quad_verts[] = {
-        -1, 1, 0, 1,
-        -1, -1, 0, 0,
-        1, -1, 1, 0,
-        -1, 1, 0, 1,
-        1, -1, 1, 0,
-        1, 1, 1, 1};
-    unsigned int quad_vao, quad_vbo;
-    glGenVertexArrays(1, &quad_vao);
-    glGenBuffers(1, &quad_vbo);
-    glBindVertexArray(quad_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(quad_verts), &quad_verts, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)(2 * sizeof(float)));
-    glBindVertexArray(0);
-
-    // load the framebuffer shader
-    Shader screen_shader("data/shaders/framebuffer.vert", "data/shaders/framebuffer.frag");
-    screen_shader.use();
-    screen_shader.set_int("screenTex", 0);
-    screen_shader.set_int("depthTex", 1);
-    screen_shader.set_int("water_normal_map", 2);
-
-    // load normal map texture for ocean
-    unsigned int water_normal_tex;
-    glGenTextures(1, &water_normal_tex);
-    glBindTexture(GL_TEXTURE_2D, water_normal_tex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    int w, h, c;
-    unsigned char *data = stbi_load("data/textures/water_normal_map.png", &w, &h, &c, 0);
-    if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    } else {
-        std::cout << "Failed to load water normal map" << std::endl;
-        return 0;
-    }
-    stbi_image_free(data);
+    // offscreen targets and shaders for the post processing effects
+    PostProcess post(fb_width, fb_height);
+
+    // declares each frame's passes and pools their transient targets
+    RenderGraph graph;
 
     // create the sphere for the planet
     Planet planet(1, 512);
@@ -173,133 +111,152 @@ int main() {
     // create a sphere for the light (sun)
     Light sun(0.5f, 8, glm::vec3(30, 0, 0));
 
+    // adjusts the planet's step counts and octaves to hold the frame budget
+    Governor governor(planet);
+
+    // flythrough recording and replay, either can be started from the command line
+    Recorder recorder;
+
+    // screenshots and fixed timestep frame sequences
+    FrameCapture capture;
+    std::string capture_dir;
+    float capture_fps = 60;
+    for (int i = 1; i + 1 < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--record") {
+            recorder.start_recording(argv[++i]);
+        } else if (arg == "--replay" && recorder.start_replay(argv[++i])) {
+            post.dynamic_resolution = false;
+        } else if (arg == "--capture") {
+            capture_dir = argv[++i];
+        } else if (arg == "--fps") {
+            capture_fps = (float)atof(argv[++i]);
+        }
+    }
+    // a replay that is captured is exported frame by frame, and the app closes once it ends
+    bool export_replay = !capture_dir.empty() && recorder.is_replaying();
+    if (!capture_dir.empty() && capture.start_sequence(capture_dir, capture_fps)) {
+        recorder.replay_dt = 1.0f / capture_fps;
+    }
+
     while (!glfwWindowShouldClose(window)) {
-        float ct = (float)glfwGetTime();
+        Profiler &profiler = Profiler::get();
+        profiler.begin_frame();
+
+        float ct = capture.frame_time(recorder.frame_time((float)glfwGetTime()));
         dt = ct - lt;
         lt = ct;
 
+        profiler.begin("input");
         process_input(window);
         glfwPollEvents();
+        profiler.end();
 
-        // calcualte camera matrices
-        glm::mat4 vp, ivp, ip, iv;
-        // projection = camera.get_projection(ASPECT_RATIO);
-        // view = camera.get_view();
-        vp = camera.get_projection(ASPECT_RATIO) * camera.get_view();
-        iv = glm::inverse(camera.get_view());
-        ip = glm::inverse(camera.get_projection(ASPECT_RATIO));
-        ivp = glm::inverse(vp);
+        // nothing to draw into while minimised
+        if (fb_width == 0 || fb_height == 0) {
+            end_frame();
+            continue;
+        }
+        post.resize(fb_width, fb_height);
 
-        // std::cout << glm::to_string(vp) << std::endl;
+        sun.update(ct);
+        recorder.update(camera, sun, planet, postprocessing, post.path);
 
-        // first pass (render to texture)
+        // time to render at, held still while an idle view is being accumulated
+        float rt = ct;
         if (postprocessing) {
-            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            rt = post.begin_frame(planet, camera, sun, ct);
         }
-        // allow for wireframe mode even when post-processing is turned on
-        if (wireframe) {
-            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        } else {
-            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+        planet.update_tiles(camera, fb_height);
+        TextureLoader::get().update();
+
+        // calcualte camera matrices
+        glm::mat4 vp = camera.get_projection((float)fb_width / (float)fb_height) * camera.get_view();
+
+        // the scene goes straight to the window unless it is post-processed
+        graph.begin(fb_width, fb_height);
+        RenderResource colour = graph.backbuffer(), depth = graph.backbuffer_depth();
+        if (postprocessing) {
+            post.add_scene_targets(graph, colour, depth);
         }
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glEnable(GL_DEPTH_TEST);
-        // glEnable(GL_CULL_FACE);
-        planet.draw(vp, camera.get_position(), sun);
 
-        sun.update(ct);
-        sun.draw(vp);
+        // culled (along with its targets) once an accumulated still has converged
+        RenderGraph::Pass &scene = graph.add_pass("scene", [&] {
+            // allow for wireframe mode even when post-processing is turned on
+            if (wireframe) {
+                GlState::get().polygon_mode(GL_LINE);
+            } else {
+                GlState::get().polygon_mode(GL_FILL);
+            }
+            GlState::get().enable(GL_DEPTH_TEST);
+            // glEnable(GL_CULL_FACE);
+            profiler.begin("terrain draw", true);
+            governor.terrain_timer.begin();
+            planet.draw(vp, camera.get_position(), sun);
+            governor.terrain_timer.end();
+            profiler.end();
+
+            profiler.begin("sun draw", true);
+            sun.draw(vp);
+            profiler.end();
+        });
+        colour = scene.attach(colour, CLEAR, glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
+        depth = scene.attach(depth, CLEAR);
 
-        // second pass (render from texture)
         if (postprocessing) {
-            // turn this back into fill (so we dont draw triangles of the quad)
-            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-            glClearColor(1, 1, 1, 1);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-            // set the framebuffer shader parameters
-            screen_shader.use();
-            // general parameters
-            screen_shader.set_vector3("cam_pos", camera.get_position());
-            screen_shader.set_vector4("near_far", camera.get_props());
-            screen_shader.set_vector3("planet_pos", planet.get_position());
-            screen_shader.set_vector3("radii", planet.get_radii());
-
-            // ocean colours
-            screen_shader.set_vector3("ocean_shallow", planet.ocean_shallow_colour);
-            screen_shader.set_vector3("ocean_deep", planet.ocean_deep_colour);
-            screen_shader.set_vector2("ocean_blends", planet.ocean_blends);
-            screen_shader.set_float("ocean_shininess", planet.ocean_shininess);
-
-            // wave
-            screen_shader.set_vector2("ocean_wave_speed", planet.ocean_wave_speed);
-            screen_shader.set_float("ocean_wave_strength", planet.ocean_wave_strength);
-
-            screen_shader.set_float("time", ct);
-
-            screen_shader.set_matrix4("ip", ip);
-            screen_shader.set_matrix4("iv", iv);
-
-            // lights (for ocean lighting)
-            screen_shader.set_vector3("light.position", sun.position);
-            screen_shader.set_vector3("light.ambient", sun.ambient);
-            screen_shader.set_vector3("light.diffuse", sun.diffuse);
-            screen_shader.set_vector3("light.specular", sun.specular);
-            screen_shader.set_matrix3("tinv", planet.get_tinv());
-
-            // atmosphere
-            screen_shader.set_int("num_inscatter_pts", planet.num_inscatter_pts);
-            screen_shader.set_int("num_od_pts", planet.num_od_pts);
-            screen_shader.set_float("density_falloff", planet.density_falloff);
-            screen_shader.set_vector3("rgb_scatter", planet.get_scatter());
-
-            // clouds
-            screen_shader.set_vector2("cloud_radii", planet.cloud_radii);
-            screen_shader.set_int("num_cloud_pts", planet.num_cloud_pts);
-
-            screen_shader.set_int("cloud_noise_octaves", planet.cloud_noise_octaves);
-            screen_shader.set_vector3("cloud_speed", planet.cloud_speed);
-            screen_shader.set_vector3("cloud_noise", planet.cloud_noise);
-
-            screen_shader.set_int("num_cloud_light_pts", planet.num_cloud_light_pts);
-            screen_shader.set_float("cloud_transmittance", planet.cloud_transmittance);
-            screen_shader.set_float("hg_g", planet.hg_g);
-            screen_shader.set_float("extinction", planet.extinction);
-
-            glBindVertexArray(quad_vao);
-
-            glDisable(GL_DEPTH_TEST);
-
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, texColourBuffer);
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, texDepthBuffer);
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, water_normal_tex);
-
-            glDrawArrays(GL_TRIANGLES, 0, 6);
-            glBindVertexArray(0);
-            glDisable(GL_BLEND);
+            post.add_passes(graph, colour, depth, planet, camera, sun, rt);
+        }
+
+        // read the frame back before the editor is drawn over it
+        RenderResource captured = postprocessing && capture.scene_only ? colour : graph.backbuffer();
+        RenderGraph::Pass &readback = graph.add_pass("capture", [&] {
+            ProfileScope scope("capture");
+            glm::ivec2 size = graph.size(captured);
+            capture.capture(graph.read_framebuffer(captured), size.x, size.y);
+        });
+        readback.read(captured);
+        readback.keep();
+
+        graph.execute();
+        if (export_replay && !recorder.is_replaying()) {
+            capture.stop_sequence();
+            glfwSetWindowShouldClose(window, true);
+        }
+
+        // accumulated frames run far more steps on purpose, so leave the knobs alone while they are
+        // and replays have to run with exactly the recorded knobs
+        if (!recorder.is_replaying() && (!postprocessing || !post.is_accumulating())) {
+            governor.update(governor.terrain_timer.get_ms(), postprocessing ? post.post_timer.get_ms() : 0);
         }
 
         // imgui
+        profiler.begin("editor");
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
         // show editor
-        Editor::show_editor(planet, camera, sun, dt, postprocessing, moving);
+        Editor::show_editor(planet, camera, sun, post, graph, governor, recorder, capture, dt, postprocessing, moving);
+        profiler.end();
 
+        profiler.begin("imgui", true);
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        profiler.end();
 
         // swap buffers and draw
+        profiler.begin("swap");
         glfwSwapBuffers(window);
+        profiler.end();
+
+        MemoryTracker::get().check_budgets();
+        end_frame();
     }
 
+    // finish writing out any captures while the context is still around
+    capture.flush();
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -309,6 +266,12 @@ int main() {
     return 0;
 }
 
+void end_frame() {
+    AllocTracker::get().end_frame();
+    GlState::get().end_frame();
+    Profiler::get().end_frame();
+}
+
 void process_input(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, true);
@@ -390,3 +353,8 @@ void scroll_callback(GLFWwindow *window, double xoff, double yoff) {
     else
         ImGui_ImplGlfw_ScrollCallback(window, xoff, yoff);
 }
+
+void framebuffer_size_callback(GLFWwindow *, int width, int height) {
+    fb_width = width;
+    fb_height = height;
+}
@@ -0,0 +1,54 @@
+#include "memory_tracker.h"
+
+#include <iostream>
+
+MemoryTracker &MemoryTracker::get() {
+    static MemoryTracker tracker;
+    return tracker;
+}
+
+void MemoryTracker::add(MemoryTag tag, size_t bytes) {
+    size_t now = used[tag].fetch_add(bytes) + bytes;
+    size_t highest = peaks[tag].load();
+    while (now > highest && !peaks[tag].compare_exchange_weak(highest, now)) {
+    }
+}
+
+void MemoryTracker::remove(MemoryTag tag, size_t bytes) {
+    used[tag].fetch_sub(bytes);
+}
+
+size_t MemoryTracker::current(MemoryTag tag) {
+    return used[tag].load();
+}
+
+size_t MemoryTracker::peak(MemoryTag tag) {
+    return peaks[tag].load();
+}
+
+size_t MemoryTracker::total(bool gpu) {
+    size_t sum = 0;
+    for (int i = 0; i < NUM_MEMORY_TAGS; i++) {
+        if (MEMORY_TAG_GPU[i] == gpu) {
+            sum += used[i].load();
+        }
+    }
+    return sum;
+}
+
+void MemoryTracker::reset_peaks() {
+    for (int i = 0; i < NUM_MEMORY_TAGS; i++) {
+        peaks[i] = used[i].load();
+    }
+}
+
+void MemoryTracker::check_budgets() {
+    for (int i = 0; i < NUM_MEMORY_TAGS; i++) {
+        bool over = budgets[i] > 0 && used[i].load() > budgets[i];
+        if (over && !over_budget[i]) {
+            std::cout << "Memory budget exceeded for " << MEMORY_TAG_NAMES[i] << ": " << used[i].load() / 1048576.0f << " MB of "
+                      << budgets[i] / 1048576.0f << " MB" << std::endl;
+        }
+        over_budget[i] = over;
+    }
+}
@@ -1,29 +1,44 @@
 #include "planet.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "artifact_cache.h"
+#include "gl_state.h"
+#include "profiler.h"
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 Planet::Planet(float radius, int squaresPerRow) : Sphere(radius, squaresPerRow) {
-    glGenTextures(1, &normal_tex);
-    glBindTexture(GL_TEXTURE_2D, normal_tex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    int w, h, c;
-    // unsigned char *data = stbi_load("data/textures/flat.png", &w, &h, &c, 0);
-    unsigned char *data = stbi_load("data/textures/terrain_normal_map.jpg", &w, &h, &c, 0);
-    if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    } else {
-        std::cout << "Failed to load terrain normal map" << std::endl;
+    // flat until the real one has streamed in
+    normal_tex = TextureLoader::get().load("data/textures/terrain_normal_map.jpg", glm::u8vec4(128, 128, 255, 255));
+
+    bake_shader.build_compute("data/shaders/bake.comp");
+}
+
+Planet::~Planet() {
+    if (store_fence) {
+        glDeleteSync(store_fence);
     }
-    stbi_image_free(data);
 }
 
-void Planet::draw(const glm::mat4 &vp, const glm::vec3 &cam_pos, const Light light) {
-    glBindVertexArray(vao);
+void Planet::draw(const glm::mat4 &vp, const glm::vec3 &cam_pos, const Light &light) {
+    if (is_project && baked_terrain && !virtual_terrain) {
+        update_terrain_map();
+    }
+    if (is_project && cubemap_detail) {
+        terrain_detail.update(normal_tex->id, model, detail_resolution, this, radius);
+    } else if (terrain_detail.texture) {
+        terrain_detail.release();
+    }
+
+    GlState::get().bind_vertex_array(vao);
     if (is_project) {
+        ProfileScope scope("uniform upload");
         planet_shader.use();
         planet_shader.set_matrix4("vp", vp);
         planet_shader.set_float("radius", radius);
@@ -59,16 +74,30 @@ void Planet::draw(const glm::mat4 &vp, const glm::vec3 &cam_pos, const Light lig
 
         // normal map
         planet_shader.set_int("terrain_normal_map", 0);
+        planet_shader.set_bool("cubemap_detail", cubemap_detail);
+        planet_shader.set_int("terrain_detail_map", 3);
+
+        // baked terrain, read by the vertices at the mip level closest to the mesh spacing
+        planet_shader.set_bool("baked_terrain", baked_terrain);
+        planet_shader.set_int("terrain_map", 1);
+        planet_shader.set_float("terrain_lod", std::max(0.0f, std::log2((float)terrain_map_resolution / get_segments())));
+
+        // streamed terrain tiles
+        planet_shader.set_bool("virtual_terrain", virtual_terrain);
+        planet_shader.set_int("vt_atlas", 2);
+        if (virtual_terrain) {
+            terrain_tiles.bind(planet_shader, 2, get_segments());
+        }
     } else {
         cube_shader.use();
         cube_shader.set_matrix4("vp", vp);
         cube_shader.set_matrix4("model", model);
     }
     // glDrawArrays(GL_POINTS, 0, total_verts);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, normal_tex);
+    GlState::get().bind_texture(0, GL_TEXTURE_2D, normal_tex->id);
+    GlState::get().bind_texture(1, GL_TEXTURE_CUBE_MAP, terrain_map);
+    GlState::get().bind_texture(3, GL_TEXTURE_CUBE_MAP, terrain_detail.texture);
     glDrawElements(GL_TRIANGLES, total_indices, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
 }
 
 glm::vec3 Planet::get_position() {
@@ -79,9 +108,154 @@ glm::vec3 Planet::get_radii() {
     return glm::vec3(ocean_radius, atmosphere_radius, radius);
 }
 
+// radius of the smallest sphere containing every postprocessing effect (ocean, clouds and atmosphere)
+float Planet::get_outer_radius() {
+    return std::max(ocean_radius, std::max(atmosphere_radius, cloud_radii.y));
+}
+
 glm::vec3 Planet::get_scatter() {
     float r = (float) pow(400 / rgb_wavelengths.x, 4);
     float g = (float) pow(400 / rgb_wavelengths.y, 4);
     float b = (float) pow(400 / rgb_wavelengths.z, 4);
     return scatter_str * glm::vec3(r, g, b);
-}
\ No newline at end of file
+}
+void Planet::update_tiles(Camera &camera, int viewport_height) {
+    if (virtual_terrain && is_project) {
+        ProfileScope scope("terrain tiles");
+        terrain_tiles.update(*this, radius, position, model[0][0], camera, viewport_height);
+    } else if (terrain_tiles.gpu_bytes() > 0) {
+        terrain_tiles.release();
+    }
+}
+
+size_t Planet::get_terrain_map_size() {
+    // rgba16f, a full mip chain adds a third
+    return (size_t)terrain_map_resolution * terrain_map_resolution * 6 * 8 * 4 / 3;
+}
+
+// everything the bake depends on
+CacheKey Planet::terrain_key() {
+    CacheKey key("terrain map");
+    key.add(radius).add(noise_mult).add(offset).add(octaves).add(noise_params).add(ocean_params).add(bake_resolution);
+    return key;
+}
+
+void Planet::update_terrain_map() {
+    CacheKey key = terrain_key();
+    if (key.hash == baked_hash) {
+        store_terrain_map();
+        return;
+    }
+    ProfileScope scope("terrain bake", true);
+
+    int res = bake_resolution;
+    if (terrain_map_resolution != res) {
+        terrain_map = GlTexture::generate();
+        GlState::get().bind_texture(GL_TEXTURE_CUBE_MAP, terrain_map);
+        glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1 + (int)std::log2(res), GL_RGBA16F, res, res);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        terrain_map_resolution = res;
+        terrain_map_bytes.set(get_terrain_map_size());
+        // filter across the face edges, or the seams of the cube show up in the terrain
+        GlState::get().enable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    }
+    GlState::get().bind_texture(GL_TEXTURE_CUBE_MAP, terrain_map);
+
+    std::shared_ptr<const Artifact> baked = ArtifactCache::get().find(key);
+    size_t face_size = (size_t)res * res * 4 * sizeof(uint16_t);
+    if (baked && baked->size() == face_size * 6) {
+        for (int face = 0; face < 6; face++) {
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, 0, 0, res, res, GL_RGBA, GL_HALF_FLOAT, baked->data() + face_size * face);
+        }
+        store_pending = false;
+    } else {
+        bake_shader.use();
+        bake_shader.set_float("radius", radius);
+        bake_shader.set_float("noise_mult", noise_mult);
+        bake_shader.set_vector3("offset", offset);
+        bake_shader.set_int("octaves", octaves);
+        bake_shader.set_vector4("noise_params", noise_params);
+        bake_shader.set_vector3("ocean_params", ocean_params);
+        glBindImageTexture(0, terrain_map, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+        // big faces go in bands of rows, so no single dispatch runs long enough to trip the driver's watchdog
+        const int band = 512;
+        for (int face = 0; face < 6; face++) {
+            bake_shader.set_int("face", face);
+            for (int row = 0; row < res; row += band) {
+                bake_shader.set_int("first_row", row);
+                glDispatchCompute((res + 7) / 8, (std::min(band, res - row) + 7) / 8, 1);
+            }
+        }
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+        store_pending = true;
+        baked_at = std::chrono::steady_clock::now();
+    }
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    GlState::get().bind_texture(GL_TEXTURE_CUBE_MAP, 0);
+    baked_hash = key.hash;
+}
+
+// the bake is read back once the terrain has not changed for a second (dragging a slider rebakes every
+// frame), without ever waiting on the gpu, and maps that could never stay in memory are skipped
+void Planet::store_terrain_map() {
+    if (store_fence) {
+        if (glClientWaitSync(store_fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            return;
+        }
+        glDeleteSync(store_fence);
+        store_fence = 0;
+
+        size_t size = store_pbo_bytes.get();
+        std::shared_ptr<std::vector<unsigned char>> texels = std::make_shared<std::vector<unsigned char>>(size);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, store_pbo);
+        void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+        if (data) {
+            memcpy(texels->data(), data, size);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        // the buffer is as big as the map, so it is not kept between stores
+        store_pbo.reset();
+        store_pbo_bytes.set(0);
+        if (!data) {
+            std::cout << "Failed to map the terrain map readback" << std::endl;
+            return;
+        }
+        storer->submit([key = store_key, texels] { ArtifactCache::get().store(key, {{texels->data(), texels->size()}}); });
+        return;
+    }
+    if (!store_pending || std::chrono::steady_clock::now() - baked_at < std::chrono::seconds(1)) {
+        return;
+    }
+    // one store at a time, the next one waits for the worker
+    if (!storer) {
+        storer = std::make_unique<ThreadPool>(1);
+    }
+    if (storer->get_pending() > 0) {
+        return;
+    }
+    store_pending = false;
+
+    int res = terrain_map_resolution;
+    size_t face_size = (size_t)res * res * 4 * sizeof(uint16_t);
+    if (!ArtifactCache::get().enabled || face_size * 6 > ArtifactCache::get().memory_cap) {
+        return;
+    }
+    store_pbo = GlBuffer::generate();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, store_pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, face_size * 6, NULL, GL_STREAM_READ);
+    store_pbo_bytes.set(face_size * 6);
+    GlState::get().bind_texture(GL_TEXTURE_CUBE_MAP, terrain_map);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (int face = 0; face < 6; face++) {
+        glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA, GL_HALF_FLOAT, (void *)(face_size * face));
+    }
+    GlState::get().bind_texture(GL_TEXTURE_CUBE_MAP, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    store_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    store_key = terrain_key();
+}
@@ -0,0 +1,562 @@
+#include "postprocess.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "gl_state.h"
+#include "profiler.h"
+#include "texture_loader.h"
+
+PostProcess::PostProcess(int width, int height) : window_width(width), window_height(height) {
+    // the running average of all accumulated frames, the only target that has to outlive a frame (the rest
+    // are transient textures of the render graph)
+    tex_history = GlTexture::generate();
+    GlState::get().bind_texture(GL_TEXTURE_2D, tex_history);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    GlState::get().bind_texture(GL_TEXTURE_2D, 0);
+
+    // load the quad on which we will render the texture on
+    float quad_verts[] = {
+        -1, 1, 0, 1,
+        -1, -1, 0, 0,
+        1, -1, 1, 0,
+        -1, 1, 0, 1,
+        1, -1, 1, 0,
+        1, 1, 1, 1};
+    quad_vao = GlVertexArray::generate();
+    quad_vbo = GlBuffer::generate();
+    GlState::get().bind_vertex_array(quad_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad_verts), &quad_verts, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)(2 * sizeof(float)));
+    GlState::get().bind_vertex_array(0);
+
+    // normal map texture for ocean, flat until it has streamed in
+    water_normal_tex = TextureLoader::get().load("data/textures/water_normal_map.png", glm::u8vec4(128, 128, 255, 255));
+
+    // build the classification pass and one kernel per tile class (class 0 is never dispatched)
+    classify_shader.build_compute("data/shaders/classify.comp");
+    for (int i = 1; i < NUM_TILE_CLASSES; i++) {
+        tile_shaders[i].build_compute("data/shaders/postprocess.comp", "#define TILE_CLASS " + std::to_string(i) + "\n");
+    }
+
+    dispatch_buffer = GlBuffer::generate();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, dispatch_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, NUM_TILE_CLASSES * 3 * sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+
+    for (GlBuffer &buffer : readback_buffers) {
+        buffer = GlBuffer::generate();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, NUM_TILE_CLASSES * 3 * sizeof(unsigned int), NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    // froxel volume kernels, their textures are transient and only allocated while the froxel path runs
+    froxel_inject_shader.build_compute("data/shaders/froxel_inject.comp");
+    froxel_accumulate_shader.build_compute("data/shaders/froxel_accumulate.comp");
+
+    tile_buffer = GlBuffer::generate();
+    allocate(width, height);
+}
+
+PostProcess::~PostProcess() {
+    for (GLsync fence : readback_fences) {
+        if (fence) {
+            glDeleteSync(fence);
+        }
+    }
+}
+
+void PostProcess::allocate(int width, int height) {
+    this->width = width;
+    this->height = height;
+    tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+    // the history is kept in full float so hundreds of frames average cleanly
+    GlState::get().bind_texture(GL_TEXTURE_2D, tex_history);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, 0);
+    GlState::get().bind_texture(GL_TEXTURE_2D, 0);
+    history_bytes.set((size_t)width * height * 16);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tile_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, NUM_TILE_CLASSES * tiles_x * tiles_y * sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    tile_bytes.set(NUM_TILE_CLASSES * tiles_x * tiles_y * sizeof(unsigned int));
+
+    // anything accumulated so far was at the old size, and the frame times are about to change
+    accumulated = 0;
+    settle_frames = 0;
+}
+
+void PostProcess::resize(int width, int height) {
+    window_width = width;
+    window_height = height;
+}
+
+void PostProcess::update_scale(bool accumulating) {
+    // post-process cost grows with the pixel count, so step the scale by the square root of the time ratio
+    // small misses are ignored and the scale moves in coarse steps, so the targets are rarely reallocated
+    settle_frames++;
+    float ms = frame_timer.get_ms();
+    if (dynamic_resolution && !accumulating && settle_frames > GPU_TIMER_FRAMES && ms > 0) {
+        float ideal = glm::clamp(render_scale * sqrtf(target_ms / ms), min_scale, 1.0f);
+        if (fabsf(ideal - render_scale) >= SCALE_STEP) {
+            render_scale = glm::clamp(roundf(ideal / SCALE_STEP) * SCALE_STEP, min_scale, 1.0f);
+        }
+    }
+
+    // stills are always accumulated at full resolution
+    float scale = accumulating ? 1 : render_scale;
+    int w = std::max(1, (int)roundf(window_width * scale));
+    int h = std::max(1, (int)roundf(window_height * scale));
+    if (w != width || h != height) {
+        allocate(w, h);
+    }
+}
+
+void PostProcess::add_scene_targets(RenderGraph &graph, RenderResource &colour, RenderResource &depth) {
+    // rgba8 so the compute path can shade it in place as an image
+    colour = graph.create_texture("scene colour", {width, height, 1, GL_RGBA8});
+    depth = graph.create_texture("scene depth", {width, height, 1, GL_DEPTH_COMPONENT24});
+}
+
+float PostProcess::begin_frame(Planet &planet, Camera &camera, Light &light, float time) {
+    // any change to the camera, light or parameters restarts the accumulation
+    uint64_t current = view_signature(planet, camera, light);
+    if (!progressive || current != signature) {
+        signature = current;
+        idle_frames = 0;
+        accumulated = 0;
+    } else {
+        idle_frames++;
+    }
+
+    update_scale(is_accumulating());
+    frame_timer.begin();
+
+    if (!is_accumulating()) {
+        march_offset = 0.5f;
+        step_scale = 1;
+        frozen_time = time;
+        return time;
+    }
+
+    // a different sub-pixel and march offset for every accumulated frame
+    int n = accumulated + 1;
+    glm::vec2 jitter = glm::vec2(halton(n, 2), halton(n, 3)) - 0.5f;
+    camera.set_jitter(jitter * 2.0f / glm::vec2(width, height));
+    march_offset = halton(n, 5);
+    step_scale = sample_scale;
+    return frozen_time;
+}
+
+glm::ivec2 PostProcess::get_render_size() {
+    return glm::ivec2(width, height);
+}
+
+bool PostProcess::is_converged() {
+    return is_accumulating() && accumulated >= max_samples;
+}
+
+bool PostProcess::is_accumulating() {
+    return progressive && idle_frames >= idle_delay;
+}
+
+uint64_t PostProcess::view_signature(Planet &planet, Camera &camera, Light &light) {
+    glm::mat4 view = camera.get_view();
+    glm::vec4 props = camera.get_props();
+    glm::vec3 planet_pos = planet.get_position();
+    float planet_radius = planet.get_radius();
+    int segments = planet.get_segments();
+
+    uint64_t h = planet.hash();
+    h = fnv1a(&view, sizeof(view), h);
+    h = fnv1a(&props, sizeof(props), h);
+    h = fnv1a(&planet_pos, sizeof(planet_pos), h);
+    h = fnv1a(&planet_radius, sizeof(planet_radius), h);
+    h = fnv1a(&segments, sizeof(segments), h);
+    h = fnv1a(&light.position, sizeof(light.position), h);
+    h = fnv1a(&light.ambient, sizeof(light.ambient), h);
+    h = fnv1a(&light.diffuse, sizeof(light.diffuse), h);
+    h = fnv1a(&light.specular, sizeof(light.specular), h);
+    h = fnv1a(&path, sizeof(path), h);
+    h = fnv1a(&sample_scale, sizeof(sample_scale), h);
+    h = fnv1a(&window_width, sizeof(window_width), h);
+    h = fnv1a(&window_height, sizeof(window_height), h);
+
+    // how the terrain and detail are drawn, which changes the image without touching the parameters
+    bool toggles[] = {planet.baked_terrain, planet.virtual_terrain, planet.cubemap_detail};
+    int resolutions[] = {planet.bake_resolution, planet.terrain_tiles.max_level, planet.detail_resolution};
+    h = fnv1a(toggles, sizeof(toggles), h);
+    h = fnv1a(resolutions, sizeof(resolutions), h);
+
+    // and so does streamed content arriving (textures replacing their placeholders, terrain tiles), samples
+    // from before it would blend the coarse image into the final one
+    int content[] = {TextureLoader::get().loaded, planet.terrain_tiles.uploads};
+    h = fnv1a(content, sizeof(content), h);
+    return h;
+}
+
+void PostProcess::add_passes(RenderGraph &graph, RenderResource colour, RenderResource depth, Planet &planet, Camera &camera, Light &light, float time) {
+    RenderResource history = graph.import_texture("history", tex_history, {width, height, 1, GL_RGBA32F});
+    if (is_converged()) {
+        add_present(graph, history, planet, camera, false);
+        return;
+    }
+
+    // passes resolve to the frame target whenever it still has to be accumulated or upscaled
+    bool accumulating = is_accumulating();
+    bool scaled = width != window_width || height != window_height;
+    bool resolve = accumulating || scaled;
+    RenderResource output = resolve ? graph.create_texture("frame", {width, height, 1, GL_RGBA16F}) : graph.backbuffer();
+
+    switch (path) {
+    case FRAGMENT_PATH:
+        output = add_fragment(graph, screen_shader, colour, depth, -1, output, planet, camera, light, time, true, !resolve);
+        break;
+    case TILED_COMPUTE_PATH:
+        output = add_compute(graph, colour, depth, output, planet, camera, light, time, !resolve);
+        break;
+    case FROXEL_PATH:
+        RenderResource scatter = add_froxel_volume(graph, planet, camera, light, time);
+        output = add_fragment(graph, froxel_shader, colour, depth, scatter, output, planet, camera, light, time, false, !resolve);
+        break;
+    }
+
+    if (accumulating) {
+        history = add_accumulate(graph, output, history);
+        add_present(graph, history, planet, camera, true);
+    } else if (scaled) {
+        add_present(graph, output, planet, camera, true);
+    }
+}
+
+// the effects are timed as one span of passes, started by the first and stopped by the last
+void PostProcess::begin_effects(Planet &planet, bool effects) {
+    Profiler::get().begin("post-process", true);
+    if (!effects) {
+        return;
+    }
+    post_timer.begin();
+
+    if (planet.cubemap_detail) {
+        // the ocean is the unit sphere scaled to its radius around the planet
+        glm::mat4 ocean_model = glm::scale(glm::translate(glm::mat4(1), planet.get_position()), glm::vec3(planet.ocean_radius));
+        water_detail.update(water_normal_tex->id, ocean_model, planet.detail_resolution);
+    } else if (water_detail.texture) {
+        water_detail.release();
+    }
+}
+
+void PostProcess::end_effects(Camera &camera, bool effects) {
+    if (effects) {
+        post_timer.end();
+    }
+    frame_timer.end();
+    camera.set_jitter(glm::vec2(0));
+    Profiler::get().end();
+}
+
+RenderResource PostProcess::add_accumulate(RenderGraph &graph, RenderResource current, RenderResource history) {
+    RenderGraph::Pass &pass = graph.add_pass("accumulate", [this, &graph, current] {
+        // running average, the n-th frame is blended in with a weight of 1 / n
+        GlState::get().polygon_mode(GL_FILL);
+        GlState::get().disable(GL_DEPTH_TEST);
+        GlState::get().enable(GL_BLEND);
+        glBlendColor(0, 0, 0, 1.0f / (accumulated + 1));
+        glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+
+        accumulate_shader.use();
+        accumulate_shader.set_int("frameTex", 0);
+        GlState::get().bind_texture(0, GL_TEXTURE_2D, graph.texture(current));
+        GlState::get().bind_vertex_array(quad_vao);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        GlState::get().disable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ZERO);
+        accumulated++;
+    });
+    pass.read(current);
+    return pass.attach(history);
+}
+
+void PostProcess::add_present(RenderGraph &graph, RenderResource source, Planet &planet, Camera &camera, bool effects) {
+    bool first = !effects;
+    RenderGraph::Pass &pass = graph.add_pass("present", [this, &graph, &planet, &camera, source, first, effects] {
+        if (first) {
+            begin_effects(planet, false);
+        }
+        if (width == window_width && height == window_height) {
+            GlState::get().bind_framebuffer(GL_READ_FRAMEBUFFER, graph.read_framebuffer(source));
+            glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        } else {
+            // bilinear upscale with contrast adaptive sharpening to win back some of the lost detail
+            GlState::get().polygon_mode(GL_FILL);
+            GlState::get().disable(GL_DEPTH_TEST);
+            upscale_shader.use();
+            upscale_shader.set_int("srcTex", 0);
+            upscale_shader.set_float("sharpness", sharpness);
+            GlState::get().bind_texture(0, GL_TEXTURE_2D, graph.texture(source));
+            GlState::get().bind_vertex_array(quad_vao);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
+        end_effects(camera, effects);
+    });
+    pass.read(source);
+    pass.attach(graph.backbuffer(), DONT_CARE);
+}
+
+void PostProcess::set_uniforms(Shader &shader, Planet &planet, Camera &camera, Light &light, float time) {
+    ProfileScope scope("uniform upload");
+    glm::mat4 iv = glm::inverse(camera.get_view());
+    glm::mat4 ip = glm::inverse(camera.get_projection((float)width / (float)height));
+
+    shader.use();
+    shader.set_int("screenTex", 0);
+    shader.set_int("depthTex", 1);
+    shader.set_int("water_normal_map", 2);
+    shader.set_int("froxelTex", 3);
+    shader.set_int("water_detail_map", 4);
+
+    // general parameters
+    shader.set_vector3("cam_pos", camera.get_position());
+    shader.set_vector4("near_far", camera.get_props());
+    shader.set_vector3("planet_pos", planet.get_position());
+    shader.set_vector3("radii", planet.get_radii());
+
+    // ocean colours
+    shader.set_vector3("ocean_shallow", planet.ocean_shallow_colour);
+    shader.set_vector3("ocean_deep", planet.ocean_deep_colour);
+    shader.set_vector2("ocean_blends", planet.ocean_blends);
+    shader.set_float("ocean_shininess", planet.ocean_shininess);
+
+    // wave
+    shader.set_vector2("ocean_wave_speed", planet.ocean_wave_speed);
+    shader.set_float("ocean_wave_strength", planet.ocean_wave_strength);
+
+    // the triplanar waves scroll by offsets, the projected ones turn the sphere by as much along its surface
+    shader.set_bool("cubemap_detail", planet.cubemap_detail);
+    glm::vec2 angles = time / 20.0f * planet.ocean_wave_speed / std::max(planet.ocean_radius, 1e-6f);
+    glm::mat3 wave_drift = glm::mat3(glm::rotate(glm::mat4(1), angles.y, glm::vec3(1, 0, 0)) * glm::rotate(glm::mat4(1), angles.x, glm::vec3(0, 1, 0)));
+    shader.set_matrix3("wave_drift", wave_drift);
+
+    shader.set_float("time", time);
+
+    shader.set_matrix4("ip", ip);
+    shader.set_matrix4("iv", iv);
+
+    // lights (for ocean lighting)
+    shader.set_vector3("light.position", light.position);
+    shader.set_vector3("light.ambient", light.ambient);
+    shader.set_vector3("light.diffuse", light.diffuse);
+    shader.set_vector3("light.specular", light.specular);
+    shader.set_matrix3("tinv", planet.get_tinv());
+
+    // atmosphere
+    shader.set_int("num_inscatter_pts", (int)(planet.num_inscatter_pts * step_scale));
+    shader.set_int("num_od_pts", (int)(planet.num_od_pts * step_scale));
+    shader.set_float("density_falloff", planet.density_falloff);
+    shader.set_vector3("rgb_scatter", planet.get_scatter());
+
+    // clouds
+    shader.set_vector2("cloud_radii", planet.cloud_radii);
+    shader.set_int("num_cloud_pts", (int)(planet.num_cloud_pts * step_scale));
+
+    shader.set_int("cloud_noise_octaves", planet.cloud_noise_octaves);
+    shader.set_vector3("cloud_speed", planet.cloud_speed);
+    shader.set_vector3("cloud_noise", planet.cloud_noise);
+
+    shader.set_int("num_cloud_light_pts", (int)(planet.num_cloud_light_pts * step_scale));
+    shader.set_float("cloud_transmittance", planet.cloud_transmittance);
+    shader.set_float("hg_g", planet.hg_g);
+    shader.set_float("extinction", planet.extinction);
+
+    // progressive mode
+    shader.set_float("march_offset", march_offset);
+
+    // tiled compute path
+    shader.set_int("max_tiles", tiles_x * tiles_y);
+
+    // froxel path, the volume only needs to span the outermost shell
+    float dist = glm::length(camera.get_position() - planet.get_position());
+    float outer = planet.get_outer_radius();
+    shader.set_vector2("froxel_range", std::max(0.01f, dist - outer), dist + outer);
+}
+
+RenderResource PostProcess::add_fragment(RenderGraph &graph, Shader &shader, RenderResource colour, RenderResource depth, RenderResource froxels, RenderResource output,
+                                         Planet &planet, Camera &camera, Light &light, float time, bool first, bool last) {
+    RenderGraph::Pass &pass = graph.add_pass("effects", [=, &graph, &shader, &planet, &camera, &light] {
+        if (first) {
+            begin_effects(planet, true);
+        }
+
+        // copy the scene across as-is, the effects are only run over the pixels covered by the planet below
+        GlState::get().bind_framebuffer(GL_READ_FRAMEBUFFER, graph.read_framebuffer(colour));
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+        // scissor the quad to the projected bounds of the outermost shell (nothing outside it is affected)
+        glm::vec4 bounds = camera.get_sphere_bounds(planet.get_position(), planet.get_outer_radius());
+        int sx = (int)floor(bounds.x * width), sy = (int)floor(bounds.y * height);
+        int sw = (int)ceil(bounds.z * width) - sx, sh = (int)ceil(bounds.w * height) - sy;
+        GlState::get().enable(GL_SCISSOR_TEST);
+        glScissor(sx, sy, sw, sh);
+
+        // set the framebuffer shader parameters
+        set_uniforms(shader, planet, camera, light, time);
+
+        GlState::get().polygon_mode(GL_FILL);
+        GlState::get().bind_vertex_array(quad_vao);
+        GlState::get().disable(GL_DEPTH_TEST);
+
+        GlState::get().bind_texture(0, GL_TEXTURE_2D, graph.texture(colour));
+        GlState::get().bind_texture(1, GL_TEXTURE_2D, graph.texture(depth));
+        GlState::get().bind_texture(2, GL_TEXTURE_2D, water_normal_tex->id);
+        GlState::get().bind_texture(3, GL_TEXTURE_3D, froxels >= 0 ? graph.texture(froxels) : 0);
+        GlState::get().bind_texture(4, GL_TEXTURE_CUBE_MAP, water_detail.texture);
+
+        if (sw > 0 && sh > 0) {
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
+        GlState::get().disable(GL_BLEND);
+        GlState::get().disable(GL_SCISSOR_TEST);
+
+        if (last) {
+            end_effects(camera, true);
+        }
+    });
+    pass.read(colour);
+    pass.read(depth);
+    if (froxels >= 0) {
+        pass.read(froxels);
+    }
+    return pass.attach(output, DONT_CARE);
+}
+
+RenderResource PostProcess::add_compute(RenderGraph &graph, RenderResource colour, RenderResource depth, RenderResource output, Planet &planet, Camera &camera, Light &light,
+                                        float time, bool last) {
+    RenderGraph::Pass &pass = graph.add_pass("tiled effects", [=, &graph, &planet, &camera, &light] {
+        begin_effects(planet, true);
+        int max_tiles = tiles_x * tiles_y;
+
+        // reset the tile counts, y and z of every indirect dispatch stay at 1
+        unsigned int reset[NUM_TILE_CLASSES * 3];
+        for (int i = 0; i < NUM_TILE_CLASSES; i++) {
+            reset[i * 3] = 0;
+            reset[i * 3 + 1] = 1;
+            reset[i * 3 + 2] = 1;
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, dispatch_buffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(reset), reset);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, dispatch_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, tile_buffer);
+
+        GlState::get().bind_texture(1, GL_TEXTURE_2D, graph.texture(depth));
+        GlState::get().bind_texture(2, GL_TEXTURE_2D, water_normal_tex->id);
+        GlState::get().bind_texture(4, GL_TEXTURE_CUBE_MAP, water_detail.texture);
+        glBindImageTexture(0, graph.texture(colour), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA8);
+
+        // bin every tile by the effects it touches
+        set_uniforms(classify_shader, planet, camera, light, time);
+        glDispatchCompute(tiles_x, tiles_y, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+        // run the specialised kernel of each class over just its own tiles
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, dispatch_buffer);
+        for (int i = 1; i < NUM_TILE_CLASSES; i++) {
+            set_uniforms(tile_shaders[i], planet, camera, light, time);
+            glDispatchComputeIndirect(i * 3 * sizeof(unsigned int));
+        }
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+        glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+
+        // copy this frame's counts out behind a fence, a copy from three frames ago that was never read is dropped
+        int slot = frame % 3;
+        if (readback_fences[slot]) {
+            glDeleteSync(readback_fences[slot]);
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, dispatch_buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readback_buffers[slot]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, NUM_TILE_CLASSES * 3 * sizeof(unsigned int));
+        readback_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        // publish the newest earlier counts the gpu has finished, however many frames the driver queues
+        for (int age = 2; age >= 1; age--) {
+            int earlier = (frame + 3 - age) % 3;
+            if (!readback_fences[earlier] || glClientWaitSync(readback_fences[earlier], 0, 0) == GL_TIMEOUT_EXPIRED) {
+                continue;
+            }
+            glDeleteSync(readback_fences[earlier]);
+            readback_fences[earlier] = 0;
+
+            unsigned int counts[NUM_TILE_CLASSES * 3];
+            glBindBuffer(GL_COPY_WRITE_BUFFER, readback_buffers[earlier]);
+            glGetBufferSubData(GL_COPY_WRITE_BUFFER, 0, sizeof(counts), counts);
+            for (int i = 0; i < NUM_TILE_CLASSES; i++) {
+                tile_counts[i] = (int)counts[i * 3];
+            }
+            tile_counts[0] = max_tiles;
+            for (int i = 1; i < NUM_TILE_CLASSES; i++) {
+                tile_counts[0] -= tile_counts[i];
+            }
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        frame++;
+
+        // present the shaded scene
+        GlState::get().bind_framebuffer(GL_READ_FRAMEBUFFER, graph.read_framebuffer(colour));
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+        if (last) {
+            end_effects(camera, true);
+        }
+    });
+    // the scene is shaded in place
+    pass.read(depth);
+    pass.write(colour);
+    return pass.attach(output, DONT_CARE);
+}
+
+RenderResource PostProcess::add_froxel_volume(RenderGraph &graph, Planet &planet, Camera &camera, Light &light, float time) {
+    glm::ivec3 groups = (FROXEL_SIZE + glm::ivec3(7, 7, 0)) / glm::ivec3(8, 8, 1);
+    RenderResource rayleigh = graph.create_texture("froxel rayleigh", {FROXEL_SIZE.x, FROXEL_SIZE.y, FROXEL_SIZE.z, GL_RGBA16F});
+    RenderResource cloud = graph.create_texture("froxel cloud", {FROXEL_SIZE.x, FROXEL_SIZE.y, FROXEL_SIZE.z, GL_RG16F});
+    RenderResource scatter = graph.create_texture("froxel scatter", {FROXEL_SIZE.x, FROXEL_SIZE.y, FROXEL_SIZE.z, GL_RGBA16F});
+
+    // evaluate the local scattering of every froxel
+    RenderGraph::Pass &inject = graph.add_pass("froxel inject", [=, &graph, &planet, &camera, &light] {
+        begin_effects(planet, true);
+        glBindImageTexture(0, graph.texture(rayleigh), 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+        glBindImageTexture(1, graph.texture(cloud), 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG16F);
+        set_uniforms(froxel_inject_shader, planet, camera, light, time);
+        glDispatchCompute(groups.x, groups.y, groups.z);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    });
+    rayleigh = inject.write(rayleigh);
+    cloud = inject.write(cloud);
+
+    // integrate it along each column
+    RenderGraph::Pass &integrate = graph.add_pass("froxel integrate", [=, &graph, &planet, &camera, &light] {
+        glBindImageTexture(0, graph.texture(rayleigh), 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA16F);
+        glBindImageTexture(1, graph.texture(cloud), 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG16F);
+        glBindImageTexture(2, graph.texture(scatter), 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+        set_uniforms(froxel_accumulate_shader, planet, camera, light, time);
+        glDispatchCompute(groups.x, groups.y, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    });
+    integrate.read(rayleigh);
+    integrate.read(cloud);
+    return integrate.write(scatter);
+}
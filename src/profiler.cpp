@@ -0,0 +1,288 @@
+#include "profiler.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "alloc_tracker.h"
+
+Profiler::Profiler() {
+    // cpu and gpu events of each frame in the history
+    for (std::vector<ProfileEvent> &frame : events) {
+        frame.reserve(PROFILER_FRAME_SCOPES * 2);
+    }
+    for (GpuFrame &slot : gpu_frames) {
+        slot.scopes.reserve(PROFILER_FRAME_SCOPES);
+    }
+    scratch.reserve(PROFILER_HISTORY);
+}
+
+Profiler &Profiler::get() {
+    static Profiler profiler;
+    return profiler;
+}
+
+double Profiler::now_us() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Profiler::begin_frame() {
+    recording = enabled;
+    if (!recording) {
+        return;
+    }
+    current++;
+
+    // read back the frame that last used this slot, it was issued PROFILER_FRAMES frames ago
+    GpuFrame &slot = gpu_frames[current % PROFILER_FRAMES];
+    resolve(slot);
+    check_spike();
+
+    // start this frame with empty times, and line the gpu clock up with the cpu one
+    int h = history_index(current);
+    events[h].clear();
+    for (ProfileStat &stat : stats) {
+        stat.cpu_ms[h] = 0;
+        stat.gpu_ms[h] = 0;
+    }
+    for (ProfileCounter &counter : counters) {
+        counter.values[h] = 0;
+    }
+    GLint64 gpu_now = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+    slot.offset_us = now_us() - gpu_now / 1000.0;
+    slot.frame = current;
+    slot.used = 0;
+    slot.scopes.clear();
+
+    begin("frame", true);
+}
+
+void Profiler::end_frame() {
+    if (!recording) {
+        return;
+    }
+    end();
+    recording = false;
+}
+
+void Profiler::begin(const char *name, bool gpu) {
+    if (!recording) {
+        return;
+    }
+    int depth = (int)stack.size();
+    OpenScope scope = {find_stat(name, depth, gpu), depth, now_us(), -1};
+    if (gpu) {
+        GpuFrame &slot = gpu_frames[current % PROFILER_FRAMES];
+        scope.query = next_query(slot);
+        glQueryCounter(slot.queries[scope.query], GL_TIMESTAMP);
+    }
+    stack.push_back(scope);
+    AllocTracker::set_site(name);
+}
+
+void Profiler::end() {
+    if (!recording || stack.empty()) {
+        return;
+    }
+    OpenScope scope = stack.back();
+    stack.pop_back();
+    AllocTracker::set_site(stack.empty() ? nullptr : stats[stack.back().stat].name);
+
+    double end_us = now_us();
+    int h = history_index(current);
+    ProfileStat &stat = stats[scope.stat];
+    stat.cpu_ms[h] += (float)((end_us - scope.start_us) / 1000.0);
+    events[h].push_back({stat.name, scope.depth, false, scope.start_us, end_us});
+
+    if (scope.query >= 0) {
+        GpuFrame &slot = gpu_frames[current % PROFILER_FRAMES];
+        int end_query = next_query(slot);
+        glQueryCounter(slot.queries[end_query], GL_TIMESTAMP);
+        slot.scopes.push_back({scope.stat, scope.depth, scope.query, end_query});
+    }
+}
+
+void Profiler::count(const char *name, float value) {
+    if (!recording) {
+        return;
+    }
+    int h = history_index(current);
+    for (ProfileCounter &counter : counters) {
+        if (counter.name == name || strcmp(counter.name, name) == 0) {
+            counter.values[h] += value;
+            return;
+        }
+    }
+    ProfileCounter counter = {name, {}};
+    counter.values[h] = value;
+    counters.push_back(counter);
+}
+
+int Profiler::find_stat(const char *name, int depth, bool gpu) {
+    for (int i = 0; i < (int)stats.size(); i++) {
+        if (stats[i].name == name || strcmp(stats[i].name, name) == 0) {
+            stats[i].has_gpu = stats[i].has_gpu || gpu;
+            return i;
+        }
+    }
+    ProfileStat stat = {name, depth, gpu, {}, {}};
+    stats.push_back(stat);
+    return (int)stats.size() - 1;
+}
+
+int Profiler::next_query(GpuFrame &slot) {
+    if (slot.used == (int)slot.queries.size()) {
+        unsigned int query;
+        glGenQueries(1, &query);
+        slot.queries.push_back(query);
+    }
+    return slot.used++;
+}
+
+void Profiler::resolve(GpuFrame &slot) {
+    if (slot.frame < 0 || slot.used == 0) {
+        return;
+    }
+    frame = slot.frame;
+
+    // queries finish in order, so the last one being ready means all of them are
+    // if it is not, drop this frame's gpu times rather than wait for them
+    int available = 0;
+    glGetQueryObjectiv(slot.queries[slot.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+        dropped_frames++;
+        return;
+    }
+
+    int h = history_index(slot.frame);
+    for (const GpuScope &scope : slot.scopes) {
+        GLuint64 start = 0, end = 0;
+        glGetQueryObjectui64v(slot.queries[scope.begin_query], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(slot.queries[scope.end_query], GL_QUERY_RESULT, &end);
+
+        ProfileStat &stat = stats[scope.stat];
+        stat.gpu_ms[h] += (end - start) / 1e6f;
+        events[h].push_back({stat.name, scope.depth, true, start / 1000.0 + slot.offset_us, end / 1000.0 + slot.offset_us});
+    }
+}
+
+int Profiler::history_size() {
+    return (int)std::min<long long>(frame + 1, PROFILER_HISTORY - PROFILER_FRAMES);
+}
+
+int Profiler::history_index(long long frame) {
+    return (int)(frame % PROFILER_HISTORY);
+}
+
+float Profiler::percentile(const float *samples, float p) {
+    int n = history_size();
+    if (n <= 0) {
+        return 0;
+    }
+    scratch.clear();
+    for (int i = 0; i < n; i++) {
+        scratch.push_back(samples[history_index(frame - i)]);
+    }
+    int k = std::min(n - 1, (int)(p / 100 * n));
+    std::nth_element(scratch.begin(), scratch.begin() + k, scratch.end());
+    return scratch[k];
+}
+
+float Profiler::average(const float *samples) {
+    int n = history_size();
+    float total = 0;
+    for (int i = 0; i < n; i++) {
+        total += samples[history_index(frame - i)];
+    }
+    return n > 0 ? total / n : 0;
+}
+
+int Profiler::timeline(const float *samples, float *out) {
+    int n = history_size();
+    for (int i = 0; i < n; i++) {
+        out[i] = samples[history_index(frame - n + 1 + i)];
+    }
+    return n;
+}
+
+bool Profiler::export_trace(const std::string &path) {
+    ProfileTrace trace;
+    snapshot(trace);
+    return write_trace(trace, path);
+}
+
+void Profiler::check_spike() {
+    if (frame < PROFILER_SPIKE_WARMUP || frame == checked || stats.empty()) {
+        return;
+    }
+    checked = frame;
+
+    // the first scope is always the whole frame, its gpu time is 0 if it was dropped
+    int h = history_index(frame);
+    if (stats[0].cpu_ms[h] > spike_ms || stats[0].gpu_ms[h] > spike_ms) {
+        spikes++;
+        if (spike_traces && spike < 0) {
+            spike = frame;
+        }
+    }
+    if (spike < 0 || frame - spike < PROFILER_SPIKE_AFTER) {
+        return;
+    }
+
+    // copying the history out is quick, formatting and writing it is left to the worker
+    std::shared_ptr<ProfileTrace> trace = std::make_shared<ProfileTrace>();
+    snapshot(*trace);
+    last_spike_trace = "spike_trace_" + std::to_string(spike) + ".json";
+    int s = history_index(spike);
+    std::cout << "Frame " << spike << " took " << stats[0].cpu_ms[s] << " ms on the cpu and " << stats[0].gpu_ms[s] << " ms on the gpu, writing " << last_spike_trace
+              << std::endl;
+    if (!writer) {
+        writer = std::make_unique<ThreadPool>(1);
+    }
+    writer->submit([trace, path = last_spike_trace] { write_trace(*trace, path); });
+    spike = -1;
+}
+
+void Profiler::snapshot(ProfileTrace &trace) {
+    // oldest frame first, counters are taken at the start of their frame
+    for (int i = history_size() - 1; i >= 0; i--) {
+        int h = history_index(frame - i);
+        for (const ProfileEvent &event : events[h]) {
+            trace.events.push_back(event);
+            if (!event.gpu && event.depth == 0) {
+                for (const ProfileCounter &counter : counters) {
+                    trace.samples.push_back({counter.name, event.start_us, counter.values[h]});
+                }
+            }
+        }
+    }
+}
+
+bool Profiler::write_trace(const ProfileTrace &trace, const std::string &path) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cout << "Failed to write trace to " << path << std::endl;
+        return false;
+    }
+
+    // cpu scopes on one track, gpu scopes on another
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+    file << std::fixed;
+    for (const ProfileEvent &event : trace.events) {
+        file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << (event.gpu ? 2 : 1) << ",\"ts\":" << event.start_us
+             << ",\"dur\":" << event.end_us - event.start_us << "}";
+    }
+    for (const ProfileSample &sample : trace.samples) {
+        file << ",\n{\"name\":\"" << sample.name << "\",\"ph\":\"C\",\"pid\":1,\"ts\":" << sample.start_us << ",\"args\":{\"value\":" << sample.value << "}}";
+    }
+    file << "\n]}\n";
+    return true;
+}
@@ -0,0 +1,192 @@
+#include "recorder.h"
+
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+Recorder::Recorder() {
+    // the parameters are addressed by their position in PlanetParams, so the log records the layout it was written with
+    PlanetParams params;
+    schema = FNV_OFFSET;
+    params.for_each_param([&](const char *name, auto &value) {
+        size_t offset = (const char *)&value - (const char *)&params;
+        size_t size = sizeof(value);
+        layout.push_back({offset, size});
+        schema = fnv1a(name, strlen(name), schema);
+        schema = fnv1a(&size, sizeof(size), schema);
+    });
+}
+
+bool Recorder::start_recording(const std::string &path) {
+    stop();
+    out.open(path, std::ios::binary);
+    if (!out.is_open()) {
+        status = "Failed to open " + path;
+        std::cout << status << std::endl;
+        return false;
+    }
+    out.write(RECORDING_MAGIC, 4);
+    write(RECORDING_VERSION);
+    write(schema);
+
+    mode = RECORDING;
+    frame = 0;
+    status = "Recording to " + path;
+    return true;
+}
+
+bool Recorder::start_replay(const std::string &path) {
+    stop();
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        status = "Failed to open " + path;
+        std::cout << status << std::endl;
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    cursor = 0;
+
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t file_schema = 0;
+    if (!read(magic) || memcmp(magic, RECORDING_MAGIC, 4) != 0 || !read(version) || version != RECORDING_VERSION || !read(file_schema)) {
+        status = path + " is not a recording";
+        std::cout << status << std::endl;
+        return false;
+    }
+    if (file_schema != schema) {
+        status = path + " was recorded with different planet parameters";
+        std::cout << status << std::endl;
+        return false;
+    }
+
+    mode = REPLAYING;
+    frame = 0;
+    status = "Replaying " + path;
+    return true;
+}
+
+void Recorder::stop() {
+    if (mode == RECORDING) {
+        out.close();
+        status = "Recorded " + std::to_string(frame) + " frames";
+    } else if (mode == REPLAYING) {
+        status = "Replayed " + std::to_string(frame) + " frames";
+    }
+    data.clear();
+    mode = IDLE;
+}
+
+float Recorder::frame_time(float wall_time) {
+    return mode == REPLAYING ? frame * replay_dt : wall_time;
+}
+
+void Recorder::update(Camera &camera, Light &light, Planet &planet, bool &postprocessing, PostProcessPath &path) {
+    if (mode == RECORDING) {
+        record_frame(camera, light, planet, postprocessing, path);
+        frame++;
+    } else if (mode == REPLAYING) {
+        if (replay_frame(camera, light, planet, postprocessing, path)) {
+            frame++;
+        } else {
+            stop();
+        }
+    }
+}
+
+void Recorder::record_frame(Camera &camera, Light &light, Planet &planet, bool postprocessing, PostProcessPath path) {
+    CameraState state = camera.get_state();
+    write(state.position);
+    write(state.yaw);
+    write(state.pitch);
+    write(state.zoom);
+
+    write(light.position);
+    write(light.ambient);
+    write(light.diffuse);
+    write(light.specular);
+    write(light.orbit_around);
+    write(light.orbit_distance);
+    write(light.orbit_period);
+    write((uint8_t)light.orbiting);
+
+    write((int32_t)planet.get_segments());
+    write(planet.get_scale());
+    write((uint8_t)planet.get_project());
+
+    write((uint8_t)postprocessing);
+    write((uint8_t)path);
+
+    // the first frame carries every parameter, later ones only what was edited
+    PlanetParams &params = planet;
+    std::vector<uint16_t> changed;
+    for (size_t i = 0; i < layout.size(); i++) {
+        const char *current = (const char *)&params + layout[i].first;
+        const char *before = (const char *)&previous + layout[i].first;
+        if (frame == 0 || memcmp(current, before, layout[i].second) != 0) {
+            changed.push_back((uint16_t)i);
+        }
+    }
+    write((uint16_t)changed.size());
+    for (uint16_t i : changed) {
+        write(i);
+        out.write((const char *)&params + layout[i].first, layout[i].second);
+    }
+    previous = params;
+}
+
+bool Recorder::replay_frame(Camera &camera, Light &light, Planet &planet, bool &postprocessing, PostProcessPath &path) {
+    CameraState state;
+    uint8_t orbiting, project, post_flag, post_path;
+    int32_t segments;
+    float scale;
+    uint16_t count;
+    bool ok = read(state.position) && read(state.yaw) && read(state.pitch) && read(state.zoom) &&
+              read(light.position) && read(light.ambient) && read(light.diffuse) && read(light.specular) &&
+              read(light.orbit_around) && read(light.orbit_distance) && read(light.orbit_period) && read(orbiting) &&
+              read(segments) && read(scale) && read(project) &&
+              read(post_flag) && read(post_path) && read(count);
+    if (!ok) {
+        return false;
+    }
+
+    // applied through the same setters as the editor, the mesh is only rebuilt when its segments change
+    camera.set_state(state);
+    light.orbiting = orbiting != 0;
+    light.set_position(light.position);
+    light.set_colour(light.diffuse);
+    if (segments != planet.get_segments()) {
+        planet.set_squares(segments);
+    }
+    if (scale != planet.get_scale()) {
+        planet.set_radius(scale);
+    }
+    if ((project != 0) != planet.get_project()) {
+        planet.project(project != 0);
+    }
+    postprocessing = post_flag != 0;
+    path = (PostProcessPath)post_path;
+
+    PlanetParams &params = planet;
+    for (int n = 0; n < count; n++) {
+        uint16_t i;
+        if (!read(i) || i >= layout.size() || cursor + layout[i].second > data.size()) {
+            return false;
+        }
+        memcpy((char *)&params + layout[i].first, &data[cursor], layout[i].second);
+        cursor += layout[i].second;
+    }
+    return true;
+}
+
+bool Recorder::is_recording() {
+    return mode == RECORDING;
+}
+
+bool Recorder::is_replaying() {
+    return mode == REPLAYING;
+}
+
+int Recorder::get_frame() {
+    return frame;
+}
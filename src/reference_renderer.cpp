@@ -0,0 +1,595 @@
+#include "reference_renderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include "planet.h"
+#include "artifact_cache.h"
+#include "terrain_noise.h"
+
+const float EPSILON = 1e-3f;
+
+static float saturate(float x) {
+    return std::min(1.0f, std::max(0.0f, x));
+}
+
+static glm::vec3 rnm(glm::vec3 a, glm::vec3 b) {
+    a += glm::vec3(0.0f, 0.0f, 1.0f);
+    b *= glm::vec3(-1.0f, -1.0f, 1.0f);
+    return a * glm::dot(a, b) / a.z - b;
+}
+
+static glm::vec2 ray_sphere(const glm::vec3 &centre, float radius, const glm::vec3 &origin, const glm::vec3 &direction) {
+    glm::vec3 off = origin - centre;
+    float a = glm::dot(direction, direction);
+    float b = 2.0f * glm::dot(off, direction);
+    float c = glm::dot(off, off) - radius * radius;
+    float d = b * b - 4.0f * a * c;
+    if (d > 0.0f) {
+        float s = sqrtf(d);
+        float near = std::max(0.0f, (-b - s) / (2.0f * a));
+        float far = (-b + s) / (2.0f * a);
+
+        if (far >= 0) {
+            return glm::vec2(near, far - near);
+        }
+    }
+    return glm::vec2(1e9f, 0.0f);
+}
+
+// bitmask of the lanes in mask whose ray hits the sphere, the lanes are independent so this vectorises
+static int packet_hits_sphere(const RayPacket &packet, const glm::vec3 &centre, float radius, int mask) {
+    glm::vec3 off = packet.origin - centre;
+    float c = glm::dot(off, off) - radius * radius;
+    int hits = 0;
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        float b = off.x * packet.dir_x[i] + off.y * packet.dir_y[i] + off.z * packet.dir_z[i];
+        float d = b * b - c;
+        hits |= (d > 0 && -b + sqrtf(std::max(d, 0.0f)) >= 0) << i;
+    }
+    return hits & mask;
+}
+
+ReferenceRenderer::ReferenceRenderer(int num_threads) : pool(num_threads) {}
+
+void ReferenceRenderer::set_scene(Planet &planet, Light &light) {
+    params = planet;
+    planet_position = planet.get_position();
+    planet_radius = planet.get_radius();
+    planet_scale = 1.0f / planet.get_tinv()[0][0];
+
+    this->light.position = light.position;
+    this->light.ambient = light.ambient;
+    this->light.diffuse = light.diffuse;
+    this->light.specular = light.specular;
+    this->light.radius = light.get_radius();
+}
+
+bool ReferenceRenderer::load_textures(const std::string &terrain_path, const std::string &water_path) {
+    bool ok = true;
+    std::pair<Texture *, const std::string *> textures[] = {{&terrain_normal_map, &terrain_path}, {&water_normal_map, &water_path}};
+    for (auto &texture : textures) {
+        int w, h;
+        std::shared_ptr<const Artifact> image = ArtifactCache::get().load_image(*texture.second, 3, w, h);
+        if (image) {
+            const unsigned char *data = ArtifactCache::image_pixels(*image);
+            texture.first->width = w;
+            texture.first->height = h;
+            texture.first->texels.assign(data, data + w * h * 3);
+        } else {
+            std::cout << "Failed to load " << *texture.second << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void ReferenceRenderer::render(Camera &camera, float time, int width, int height, std::vector<glm::vec4> &image) {
+    auto start = std::chrono::steady_clock::now();
+
+    Frame frame;
+    frame.iv = glm::inverse(camera.get_view());
+    frame.ip = glm::inverse(camera.get_projection((float)width / (float)height));
+    frame.cam_pos = camera.get_position();
+    frame.near_far = glm::vec2(camera.get_props());
+    frame.radii = glm::vec3(params.ocean_radius, params.atmosphere_radius, planet_radius);
+    frame.rgb_scatter = params.scatter_str * glm::pow(400.0f / params.rgb_wavelengths, glm::vec3(4));
+    frame.num_inscatter_pts = (int)(params.num_inscatter_pts * step_scale);
+    frame.num_od_pts = (int)(params.num_od_pts * step_scale);
+    frame.num_cloud_pts = (int)(params.num_cloud_pts * step_scale);
+    frame.num_cloud_light_pts = (int)(params.num_cloud_light_pts * step_scale);
+    frame.time = time;
+
+    // every height npos can return, the smooth max bulges by at most a quarter of the smoothing
+    float nm = fabsf(params.noise_mult);
+    float floor_ht = -params.ocean_params.x * nm;
+    float lo = std::min(-nm, floor_ht);
+    float hi = std::max(nm, floor_ht) + fabsf(params.ocean_params.y) / 4;
+    float sunk = lo * params.ocean_params.z;
+    frame.terrain_min = std::max(0.0f, planet_radius + std::min(std::min(lo, sunk), 0.0f)) * 0.999f;
+    frame.terrain_max = (planet_radius + std::max(std::max(hi, sunk), 0.0f)) * 1.001f;
+
+    frame.outer_radius = frame.terrain_max * planet_scale;
+    if (postprocessing) {
+        frame.outer_radius = std::max(frame.outer_radius, std::max(params.ocean_radius, std::max(params.atmosphere_radius, params.cloud_radii.y)));
+    }
+
+    image.assign((size_t)width * height, glm::vec4(0));
+    int tiles_x = (width + REFERENCE_TILE_SIZE - 1) / REFERENCE_TILE_SIZE;
+    int tiles_y = (height + REFERENCE_TILE_SIZE - 1) / REFERENCE_TILE_SIZE;
+
+    // one pass over the image per sample, each with its own jitter and march offset like progressive mode
+    for (int s = 0; s < samples; s++) {
+        frame.jitter = samples > 1 ? glm::vec2(halton(s + 1, 2), halton(s + 1, 3)) : glm::vec2(0.5f);
+        frame.march_offset = samples > 1 ? halton(s + 1, 5) : 0.5f;
+        pool.parallel_for(tiles_x * tiles_y, [&](int tile) {
+            render_tile(frame, tile, width, height, image);
+        });
+    }
+
+    render_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void ReferenceRenderer::to_rgba8(const std::vector<glm::vec4> &image, std::vector<unsigned char> &pixels) {
+    pixels.resize(image.size() * 4);
+    for (size_t i = 0; i < image.size(); i++) {
+        glm::vec4 c = glm::clamp(image[i], 0.0f, 1.0f) * 255.0f + 0.5f;
+        for (int k = 0; k < 4; k++) {
+            pixels[i * 4 + k] = (unsigned char)c[k];
+        }
+    }
+}
+
+void ReferenceRenderer::render_tile(const Frame &frame, int tile, int width, int height, std::vector<glm::vec4> &image) {
+    int tiles_x = (width + REFERENCE_TILE_SIZE - 1) / REFERENCE_TILE_SIZE;
+    int x0 = (tile % tiles_x) * REFERENCE_TILE_SIZE;
+    int y0 = (tile / tiles_x) * REFERENCE_TILE_SIZE;
+    int x1 = std::min(width, x0 + REFERENCE_TILE_SIZE);
+    int y1 = std::min(height, y0 + REFERENCE_TILE_SIZE);
+    float weight = 1.0f / samples;
+
+    RayPacket packet;
+    packet.origin = frame.cam_pos;
+    glm::vec4 colours[PACKET_SIZE];
+    for (int y = y0; y < y1; y += 2) {
+        for (int x = x0; x < x1; x += 2) {
+            // lanes are (x, y), (x + 1, y), (x, y + 1), (x + 1, y + 1), and off the edge of odd sizes
+            int mask = 0;
+            for (int i = 0; i < PACKET_SIZE; i++) {
+                int px = x + (i & 1);
+                int py = y + (i >> 1);
+                glm::vec2 uv = (glm::vec2(px, py) + frame.jitter) / glm::vec2(width, height);
+                glm::vec3 view_vector = glm::vec3(frame.iv * glm::vec4(glm::vec3(frame.ip * glm::vec4(uv * 2.0f - 1.0f, 0.0f, 1.0f)), 0.0f));
+                glm::vec3 dir = glm::normalize(view_vector);
+                packet.dir_x[i] = dir.x;
+                packet.dir_y[i] = dir.y;
+                packet.dir_z[i] = dir.z;
+                packet.view_length[i] = glm::length(view_vector);
+                mask |= (px < x1 && py < y1) << i;
+            }
+
+            trace_packet(frame, packet, mask, colours);
+
+            for (int i = 0; i < PACKET_SIZE; i++) {
+                if (mask & (1 << i)) {
+                    image[(size_t)(y + (i >> 1)) * width + x + (i & 1)] += colours[i] * weight;
+                }
+            }
+        }
+    }
+}
+
+void ReferenceRenderer::trace_packet(const Frame &frame, const RayPacket &packet, int mask, glm::vec4 *out) {
+    // lanes that miss both the planet's outer shell and the sun only ever see the clear colour
+    int active = packet_hits_sphere(packet, planet_position, frame.outer_radius, mask);
+    active |= packet_hits_sphere(packet, light.position, light.radius, mask);
+
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        out[i] = glm::vec4(clear_colour, 1.0f);
+        if (!(active & (1 << i))) {
+            continue;
+        }
+        glm::vec3 dir = glm::vec3(packet.dir_x[i], packet.dir_y[i], packet.dir_z[i]);
+        Hit hit = trace_scene(frame, packet.origin, dir, packet.view_length[i]);
+        out[i] = postprocessing ? postprocess(frame, dir, hit) : hit.colour;
+    }
+}
+
+ReferenceRenderer::Hit ReferenceRenderer::trace_scene(const Frame &frame, const glm::vec3 &origin, const glm::vec3 &dir, float view_length) {
+    // an empty pixel is at the far plane, as linear_depth(1) * length(view_vector)
+    Hit hit = {frame.near_far.y * view_length, glm::vec4(clear_colour, 1.0f)};
+
+    float t;
+    if (intersect_terrain(frame, origin, dir, t)) {
+        glm::vec3 p = (origin + dir * t - planet_position) / planet_scale;
+        glm::vec3 cube_pos = p * (planet_radius / sqrtf(3.0f) / std::max(fabsf(p.x), std::max(fabsf(p.y), fabsf(p.z))));
+        hit = {t, glm::vec4(shade_terrain(frame, cube_pos), 1.0f)};
+    }
+
+    // the sun is drawn as a flat sphere
+    glm::vec2 sun = ray_sphere(light.position, light.radius, origin, dir);
+    if (sun.y > 0 && sun.x < hit.depth && sun.x > frame.near_far.x) {
+        hit = {sun.x, glm::vec4(light.colour, 1.0f)};
+    }
+    return hit;
+}
+
+// march along the ray through the shell the terrain can be in, stepping by a fraction of the height above
+// the surface, then bisect the step that went below it
+bool ReferenceRenderer::intersect_terrain(const Frame &frame, const glm::vec3 &origin, const glm::vec3 &dir, float &t) {
+    glm::vec3 o = (origin - planet_position) / planet_scale;
+    glm::vec2 shell = ray_sphere(glm::vec3(0), frame.terrain_max, o, dir);
+    if (shell.y <= 0) {
+        return false;
+    }
+
+    float ht;
+    auto above = [&](float s) {
+        glm::vec3 p = o + dir * s;
+        float r = glm::length(p);
+        if (r < frame.terrain_min) {
+            return r - frame.terrain_min;
+        }
+        glm::vec3 cube_pos = p * (planet_radius / sqrtf(3.0f) / std::max(fabsf(p.x), std::max(fabsf(p.y), fabsf(p.z))));
+        return r - glm::length(terrain_position(cube_pos, ht));
+    };
+
+    float near = std::max(shell.x, frame.near_far.x / planet_scale);
+    float far = shell.x + shell.y;
+    float min_step = (frame.terrain_max - frame.terrain_min) * 1e-4f;
+
+    float s = near;
+    float f = above(s);
+    for (int i = 0; i < 4096 && f >= 0; i++) {
+        float next = s + std::max(f * 0.5f, min_step);
+        if (next > far) {
+            return false;
+        }
+        float fn = above(next);
+        if (fn < 0) {
+            // the surface is between s and next
+            float a = s, b = next;
+            for (int k = 0; k < 20; k++) {
+                float m = (a + b) * 0.5f;
+                if (above(m) < 0) {
+                    b = m;
+                } else {
+                    a = m;
+                }
+            }
+            t = b * planet_scale;
+            return true;
+        }
+        s = next;
+        f = fn;
+    }
+    if (f < 0) {
+        t = s * planet_scale;
+        return true;
+    }
+    return false;
+}
+
+// npos from planet.vert
+glm::vec3 ReferenceRenderer::terrain_position(const glm::vec3 &cube_pos, float &local_ht) {
+    return terrain_point(params, planet_radius, cube_pos, local_ht);
+}
+
+// planet.vert's normal and planet.frag, at a point of the cube the sphere was built from
+glm::vec3 ReferenceRenderer::shade_terrain(const Frame &frame, const glm::vec3 &cube_pos) {
+    float local_ht;
+    glm::vec3 sphere_pos = terrain_position(cube_pos, local_ht);
+
+    glm::vec3 local_up = glm::normalize(cube_pos);
+    glm::vec3 position = planet_position + sphere_pos * planet_scale;
+    glm::vec3 normal = terrain_normal(params, planet_radius, cube_pos, sphere_pos, params.noise_params.w);
+
+    float steepness = 1.0f - glm::dot(normal, local_up);
+
+    float slope_threshold = params.colour_params.x;
+    float slope_blend = params.colour_params.y;
+    float snow_threshold = params.colour_params.z;
+    float snow_blend = params.colour_params.w;
+    float grass_threshold = params.colour_params2.x;
+    float grass_blend = params.colour_params2.y;
+    float shore_threshold = params.colour_params2.z;
+    float shore_blend = params.colour_params2.w;
+    float seafloor_threshold = params.seafloor_params.x;
+    float seafloor_blend = params.seafloor_params.y;
+
+    // grass only when the terrain is relatively flat
+    float slope_blend_ht = slope_threshold * (1.0f - slope_blend);
+    float slope_weight = saturate((steepness - slope_blend_ht) / (slope_threshold - slope_blend_ht));
+    glm::vec3 land_col = glm::mix(params.grass_colour, params.rock_colour, slope_weight);
+
+    // grass only below a certain elevation
+    float grass_blend_ht = grass_threshold * (1.0f - grass_blend);
+    float grass_weight = saturate((local_ht - grass_blend_ht) / (grass_threshold - grass_blend_ht));
+    land_col = glm::mix(land_col, params.rock_colour, grass_weight);
+
+    // shore only below a certain elevation
+    float shore_blend_ht = shore_threshold * (1.0f - shore_blend);
+    float shore_weight = saturate((local_ht - shore_blend_ht) / (shore_threshold - shore_blend_ht));
+    land_col = glm::mix(params.shore_colour, land_col, shore_weight);
+
+    // seafloor when below 0
+    float seafloor_blend_ht = seafloor_threshold * (1.0f - seafloor_blend);
+    float seafloor_weight = saturate((local_ht - seafloor_blend_ht) / (seafloor_threshold - seafloor_blend_ht));
+    land_col = glm::mix(params.seafloor_colour, land_col, seafloor_weight);
+
+    // snow past a certain elevation
+    float snow_blend_ht = snow_threshold * (1.0f - snow_blend);
+    float snow_weight = saturate((local_ht - snow_blend_ht) / (snow_threshold - snow_blend_ht));
+    land_col = glm::mix(land_col, params.snow_colour, snow_weight);
+
+    // triplanar normal map
+    glm::vec3 nn = glm::normalize(normal);
+    glm::vec3 norm = triplanar_normal(terrain_normal_map, nn, position, glm::vec2(0));
+    norm = glm::mix(nn, norm, params.normal_map_str);
+
+    // phong lighting
+    glm::vec3 ambient = light.ambient;
+
+    glm::vec3 light_dir = glm::normalize(light.position - position);
+    float diff = std::max(glm::dot(norm, light_dir), 0.0f);
+    glm::vec3 diffuse = light.diffuse * diff;
+
+    glm::vec3 view_dir = glm::normalize(frame.cam_pos - position);
+    glm::vec3 reflect_dir = glm::reflect(-light_dir, norm);
+    float spec = powf(std::max(glm::dot(view_dir, reflect_dir), 0.0f), params.shininess);
+    glm::vec3 specular = light.specular * spec * params.spec_str;
+
+    return (ambient + diffuse + specular) * land_col;
+}
+
+// bilinear, repeating lookup like a GL_LINEAR texture without mipmaps
+glm::vec3 ReferenceRenderer::sample(const Texture &texture, glm::vec2 uv) {
+    if (texture.texels.empty()) {
+        return glm::vec3(0.5f, 0.5f, 1.0f);
+    }
+    glm::vec2 st = uv * glm::vec2(texture.width, texture.height) - 0.5f;
+    glm::vec2 base = glm::floor(st);
+    glm::vec2 f = st - base;
+
+    glm::vec3 texels[4];
+    for (int i = 0; i < 4; i++) {
+        int x = ((int)base.x + (i & 1)) % texture.width;
+        int y = ((int)base.y + (i >> 1)) % texture.height;
+        x += x < 0 ? texture.width : 0;
+        y += y < 0 ? texture.height : 0;
+        const unsigned char *t = &texture.texels[((size_t)y * texture.width + x) * 3];
+        texels[i] = glm::vec3(t[0], t[1], t[2]) / 255.0f;
+    }
+    return glm::mix(glm::mix(texels[0], texels[1], f.x), glm::mix(texels[2], texels[3], f.x), f.y);
+}
+
+// x and y of a normal map texel, with z rebuilt like the shaders do for the two channel compressed maps
+static glm::vec3 unpack_normal(const glm::vec3 &texel) {
+    glm::vec2 xy = glm::vec2(texel) * 2.0f - 1.0f;
+    return glm::vec3(xy, sqrtf(std::max(0.0f, 1.0f - glm::dot(xy, xy))));
+}
+
+// reoriented normal mapping of three planar projections, blended by the normal
+glm::vec3 ReferenceRenderer::triplanar_normal(const Texture &texture, const glm::vec3 &nn, const glm::vec3 &pos, glm::vec2 offsets) {
+    glm::vec3 blend = glm::abs(nn);
+    blend = glm::max(blend - 0.2f, 0.0f);
+    blend /= glm::dot(blend, glm::vec3(1.0f));
+
+    glm::vec2 uvx = glm::vec2(pos.z, pos.y) + offsets;
+    glm::vec2 uvy = glm::vec2(pos.x, pos.z) + offsets;
+    glm::vec2 uvz = glm::vec2(pos.x, pos.y) + offsets;
+
+    glm::vec3 tnx = unpack_normal(sample(texture, uvx));
+    glm::vec3 tny = unpack_normal(sample(texture, uvy));
+    glm::vec3 tnz = unpack_normal(sample(texture, uvz));
+
+    glm::vec3 avn = glm::abs(nn);
+    tnx = rnm(glm::vec3(nn.z, nn.y, avn.x), tnx);
+    tny = rnm(glm::vec3(nn.x, nn.z, avn.y), tny);
+    tnz = rnm(glm::vec3(nn.x, nn.y, avn.z), tnz);
+
+    glm::vec3 asign = glm::sign(nn);
+    tnx.z *= asign.x;
+    tny.z *= asign.y;
+    tnz.z *= asign.z;
+
+    return glm::normalize(tnx * blend.x + tny * blend.y + tnz * blend.z + nn);
+}
+
+glm::vec4 ReferenceRenderer::postprocess(const Frame &frame, const glm::vec3 &dir, const Hit &hit) {
+    glm::vec4 colour = hit.colour;
+    const glm::vec3 &cam_pos = frame.cam_pos;
+
+    // distance from camera to the planet surface/ocean
+    float surface_dst = shade_ocean(frame, dir, hit.depth, colour);
+
+    // clouds and atmosphere, integrated together along the view ray
+    glm::vec2 cloud_hit_info = ray_sphere(planet_position, params.cloud_radii.y, cam_pos, dir);
+    float cvd = std::min(cloud_hit_info.y, surface_dst - cloud_hit_info.x);
+
+    glm::vec2 atmosphere_hit_info = ray_sphere(planet_position, frame.radii.y, cam_pos, dir);
+    float avd = std::min(atmosphere_hit_info.y, surface_dst - atmosphere_hit_info.x);
+
+    glm::vec4 segments = glm::vec4(1e9f, -1e9f, 1e9f, -1e9f);
+    if (avd > 0) {
+        segments.x = atmosphere_hit_info.x + EPSILON;
+        segments.y = atmosphere_hit_info.x + avd - EPSILON;
+    }
+    if (cvd > 0) {
+        segments.z = cloud_hit_info.x + EPSILON;
+        segments.w = cloud_hit_info.x + cvd - EPSILON;
+    }
+    if (segments.x < segments.y || segments.z < segments.w) {
+        colour = glm::vec4(integrate_scattering(frame, dir, segments, glm::vec3(colour)), 1.0f);
+    }
+    return colour;
+}
+
+float ReferenceRenderer::shade_ocean(const Frame &frame, const glm::vec3 &dir, float scene_depth, glm::vec4 &colour) {
+    glm::vec2 ocean_hit_info = ray_sphere(planet_position, frame.radii.x, frame.cam_pos, dir);
+    float ocean_dst_to = ocean_hit_info.x;
+    float ovd = std::min(ocean_hit_info.y, scene_depth - ocean_dst_to);
+    glm::vec3 ocean_pt = frame.cam_pos + dir * ocean_dst_to;
+
+    if (ovd > 0) {
+        float t = 1.0f - expf(-ovd * params.ocean_blends.x);
+        float alpha = 1.0f - expf(-ovd * params.ocean_blends.y);
+
+        glm::vec3 ocean_colour = glm::mix(params.ocean_shallow_colour, params.ocean_deep_colour, t);
+
+        // the model only translates and scales uniformly, so tinv never changes a normalised direction
+        glm::vec3 ocean_normal = glm::normalize(ocean_pt - planet_position);
+        glm::vec3 light_dir = glm::normalize(light.position - planet_position);
+
+        // make the waves move
+        glm::vec2 offsets = frame.time / 20.0f * params.ocean_wave_speed;
+        glm::vec3 norm = triplanar_normal(water_normal_map, ocean_normal, ocean_pt, offsets);
+        norm = glm::normalize(glm::mix(ocean_normal, norm, params.ocean_wave_strength));
+
+        // diffuse colour
+        float diff = glm::clamp(glm::dot(norm, light_dir), 0.0f, 1.0f);
+        glm::vec3 diffuse = light.diffuse * diff;
+
+        // specular highlights
+        glm::vec3 view_dir = glm::normalize(frame.cam_pos - ocean_pt);
+        glm::vec3 reflect_dir = glm::reflect(-light_dir, norm);
+        float spec = powf(std::max(glm::dot(view_dir, reflect_dir), 0.0f), params.ocean_shininess);
+        glm::vec3 specular = light.specular * spec;
+
+        ocean_colour = (diffuse + specular) * ocean_colour;
+        colour = glm::mix(colour, glm::vec4(ocean_colour, 1.0f), alpha);
+    }
+
+    return std::min(scene_depth, ocean_dst_to);
+}
+
+// the merged front to back march of postprocess.glsl over the atmosphere (x to y) and cloud (z to w) segments
+glm::vec3 ReferenceRenderer::integrate_scattering(const Frame &frame, const glm::vec3 &dir, glm::vec4 segments, glm::vec3 orig_colour) {
+    float atmos_step = (segments.y - segments.x) / frame.num_inscatter_pts;
+    float cloud_step = (segments.w - segments.z) / frame.num_cloud_pts;
+
+    glm::vec3 in_light = glm::vec3(0.0f);
+    float view_od = 0.0f;
+    float cloud_trans = 1.0f;
+
+    float t = std::min(segments.x, segments.z);
+    float t_end = std::max(segments.y, segments.w);
+    // capped like the shader, in case t stops moving
+    int max_steps = frame.num_inscatter_pts + frame.num_cloud_pts + 8;
+    for (int step = 0; step < max_steps && t < t_end; step++) {
+        bool in_atmos = t >= segments.x && t < segments.y;
+        bool in_cloud = t >= segments.z && t < segments.w;
+
+        // never step across a segment boundary, so every sample lies in a single region
+        float boundary = t_end;
+        for (int i = 0; i < 4; i++) {
+            if (segments[i] > t) {
+                boundary = std::min(boundary, segments[i]);
+            }
+        }
+        if (!in_atmos && !in_cloud) {
+            t = boundary;
+            continue;
+        }
+        float stepsize = std::min(in_cloud ? cloud_step : atmos_step, boundary - t);
+        glm::vec3 pt = frame.cam_pos + dir * (t + frame.march_offset * stepsize);
+        glm::vec3 light_dir = glm::normalize(light.position - pt);
+
+        if (in_atmos) {
+            float sun_ray_length = ray_sphere(planet_position, frame.radii.y, pt, light_dir).y;
+            float sun_ray_od = optical_depth(frame, pt, light_dir, sun_ray_length);
+            float local_density = density_at_pt(frame, pt);
+            glm::vec3 transmittance = glm::exp(-(sun_ray_od + view_od) * frame.rgb_scatter) * std::min(cloud_trans, 1.0f);
+
+            in_light += local_density * transmittance * frame.rgb_scatter * stepsize;
+            view_od += local_density * stepsize;
+        }
+
+        if (in_cloud) {
+            float density = cloud_density_at_pt(frame, pt);
+            if (density > 0) {
+                float lt = lightmarch(frame, pt, light_dir) * hg(glm::dot(dir, light_dir));
+                in_light += glm::vec3(density * stepsize * cloud_trans * expf(-view_od) * lt);
+                cloud_trans *= expf(-density * stepsize * params.extinction);
+            }
+        }
+
+        // nothing behind an opaque cloud (or thick enough atmosphere) is visible any more
+        if (cloud_trans * expf(-view_od) < 0.01f) {
+            return in_light;
+        }
+        // a step below half an ulp of t would leave it where it is, go straight to the boundary then
+        float next = t + stepsize;
+        t = next >= boundary || next <= t ? boundary : next;
+    }
+
+    return orig_colour * cloud_trans * expf(-view_od) + in_light;
+}
+
+float ReferenceRenderer::density_at_pt(const Frame &frame, const glm::vec3 &pt) {
+    float ht_above_surface = glm::length(pt - planet_position) - frame.radii.z;
+    float ht01 = ht_above_surface / (frame.radii.y - frame.radii.z);
+    return expf(-ht01 * params.density_falloff) * (1 - ht01);
+}
+
+float ReferenceRenderer::optical_depth(const Frame &frame, glm::vec3 origin, const glm::vec3 &dir, float ray_length) {
+    float stepsize = ray_length / (frame.num_od_pts - 1);
+    float od = 0.0f;
+    for (int i = 0; i < frame.num_od_pts; i++) {
+        od += density_at_pt(frame, origin) * stepsize;
+        origin += dir * stepsize;
+    }
+    return od;
+}
+
+float ReferenceRenderer::fbm(const Frame &frame, const glm::vec3 &pos) {
+    float frequency = params.cloud_noise.x;
+    float persistence = params.cloud_noise.y;
+    float lacunarity = params.cloud_noise.z;
+
+    float nsum = 0.0f;
+    float amplitude = 1.0f;
+    float total_amp = 0.0f;
+
+    glm::vec3 offsets = frame.time / 20.0f * params.cloud_speed;
+
+    for (int i = 0; i < params.cloud_noise_octaves; i++) {
+        nsum += snoise(pos * frequency + offsets) * amplitude;
+        total_amp += amplitude;
+        amplitude *= persistence;
+        frequency *= lacunarity;
+    }
+    return nsum / total_amp;
+}
+
+float ReferenceRenderer::cloud_density_at_pt(const Frame &frame, const glm::vec3 &pt) {
+    glm::vec2 cloud_radii = params.cloud_radii;
+    float ht = glm::length(pt - planet_position);
+    float h = 2.0f * glm::clamp(ht - cloud_radii.x, 0.0f, cloud_radii.y - cloud_radii.x) / (cloud_radii.y - cloud_radii.x) - 1.0f;
+    h = 1.0f - h * h;
+    if (h > 0) {
+        return h * fbm(frame, pt);
+    }
+    return 0;
+}
+
+float ReferenceRenderer::hg(float a) {
+    float g2 = params.hg_g * params.hg_g;
+    return (1 - g2) / (4 * PI * powf(1 + g2 - 2 * params.hg_g * a, 1.5f));
+}
+
+// how much light travels along light_dir to reach pt
+float ReferenceRenderer::lightmarch(const Frame &frame, const glm::vec3 &pt, const glm::vec3 &light_dir) {
+    float dst_thr = ray_sphere(planet_position, params.cloud_radii.y, pt, light_dir).y;
+    glm::vec3 cloud_pt = pt;
+    float total_density = 0;
+
+    float stepsize = dst_thr / (frame.num_cloud_light_pts - 1);
+    for (int i = 0; i < frame.num_cloud_light_pts; i++) {
+        total_density += std::max(0.0f, cloud_density_at_pt(frame, cloud_pt)) * stepsize;
+        cloud_pt += light_dir * stepsize;
+    }
+    return expf(-params.cloud_transmittance * total_density);
+}
@@ -0,0 +1,411 @@
+#include "render_graph.h"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+
+#include "gl_state.h"
+
+RenderResource RenderGraph::Pass::new_version(RenderResource r) {
+    int resource = graph->versions[r].resource;
+    if (graph->resources[resource].latest != r) {
+        std::cout << "Render graph: " << name << " writes over an old version of " << graph->resources[resource].name << std::endl;
+    }
+    RenderResource written = (RenderResource)graph->versions.size();
+    graph->versions.push_back({resource, index});
+    graph->resources[resource].latest = written;
+    inputs.push_back(r);
+    outputs.push_back(written);
+    return written;
+}
+
+RenderResource RenderGraph::Pass::attach(RenderResource r, LoadOp load, glm::vec4 clear) {
+    RenderResource written = new_version(r);
+    attachments.push_back({r, written, load, clear});
+    return written;
+}
+
+void RenderGraph::Pass::read(RenderResource r) {
+    reads.push_back(r);
+}
+
+RenderResource RenderGraph::Pass::write(RenderResource r) {
+    return new_version(r);
+}
+
+void RenderGraph::Pass::keep() {
+    kept = true;
+}
+
+void RenderGraph::begin(int width, int height, unsigned int target) {
+    pass_count = 0;
+    closure_block = 0;
+    closure_offset = 0;
+    resources.clear();
+    versions.clear();
+    window_width = width;
+    window_height = height;
+    window_framebuffer = target;
+    window_colour = add_resource("backbuffer", {width, height, 1, GL_RGBA8}, true, true, 0);
+    window_depth = add_resource("backbuffer depth", {width, height, 1, GL_DEPTH_COMPONENT24}, true, true, 0);
+}
+
+RenderResource RenderGraph::backbuffer() {
+    return resources[versions[window_colour].resource].latest;
+}
+
+RenderResource RenderGraph::backbuffer_depth() {
+    return resources[versions[window_depth].resource].latest;
+}
+
+RenderResource RenderGraph::create_texture(const char *name, const TextureDesc &desc) {
+    return add_resource(name, desc, false, false, 0);
+}
+
+RenderResource RenderGraph::import_texture(const char *name, unsigned int texture, const TextureDesc &desc) {
+    return add_resource(name, desc, true, false, texture);
+}
+
+RenderResource RenderGraph::add_resource(const char *name, const TextureDesc &desc, bool imported, bool is_backbuffer, unsigned int texture) {
+    RenderResource version = (RenderResource)versions.size();
+    resources.push_back({name, desc, imported, is_backbuffer, texture, -1, version, -1, -1});
+    versions.push_back({(int)resources.size() - 1, -1});
+    return version;
+}
+
+RenderGraph::Pass &RenderGraph::new_pass(const char *name) {
+    if (pass_count == (int)pass_list.size()) {
+        pass_list.emplace_back();
+    }
+    Pass &pass = pass_list[pass_count];
+    pass.graph = this;
+    pass.index = pass_count++;
+    pass.name = name;
+    pass.attachments.clear();
+    pass.reads.clear();
+    pass.inputs.clear();
+    pass.outputs.clear();
+    pass.kept = false;
+    return pass;
+}
+
+void *RenderGraph::closure_memory(size_t size, size_t align) {
+    size_t offset = (closure_offset + align - 1) / align * align;
+    if (closure_block < closure_blocks.size() && offset + size > RENDER_GRAPH_CLOSURE_BLOCK) {
+        closure_block++;
+        offset = 0;
+    }
+    // a block is only added when a frame declares more than the ones before it
+    if (closure_block == closure_blocks.size()) {
+        closure_blocks.emplace_back(new char[RENDER_GRAPH_CLOSURE_BLOCK]);
+    }
+    closure_offset = offset + size;
+    return closure_blocks[closure_block].get() + offset;
+}
+
+void RenderGraph::schedule() {
+    int n = pass_count;
+
+    // a pass is needed if it is kept, writes something that outlives the frame, or writes something a needed
+    // pass uses
+    needed.assign(n, false);
+    stack.clear();
+    for (int i = 0; i < n; i++) {
+        Pass &pass = pass_list[i];
+        bool outlives = false;
+        for (RenderResource r : pass.outputs) {
+            outlives = outlives || resources[versions[r].resource].imported;
+        }
+        if (pass.kept || outlives) {
+            needed[pass.index] = true;
+            stack.push_back(pass.index);
+        }
+    }
+    while (!stack.empty()) {
+        Pass &pass = pass_list[stack.back()];
+        stack.pop_back();
+        for (const std::vector<RenderResource> *used : {&pass.reads, &pass.inputs}) {
+            for (RenderResource r : *used) {
+                int producer = versions[r].producer;
+                if (producer >= 0 && !needed[producer]) {
+                    needed[producer] = true;
+                    stack.push_back(producer);
+                }
+            }
+        }
+    }
+
+    // every pass runs after the producers of what it uses, and after the readers of what it writes over
+    if ((int)after.size() < n) {
+        after.resize(n);
+    }
+    for (int i = 0; i < n; i++) {
+        after[i].clear();
+    }
+    waiting.assign(n, 0);
+    auto depend = [&](int first, int then) {
+        if (first >= 0 && first != then && needed[first]) {
+            after[first].push_back(then);
+            waiting[then]++;
+        }
+    };
+    for (int i = 0; i < n; i++) {
+        Pass &pass = pass_list[i];
+        if (!needed[i]) {
+            continue;
+        }
+        for (RenderResource r : pass.reads) {
+            depend(versions[r].producer, i);
+        }
+        for (RenderResource r : pass.inputs) {
+            depend(versions[r].producer, i);
+            for (int reader = 0; reader < n; reader++) {
+                const std::vector<RenderResource> &reads = pass_list[reader].reads;
+                if (std::find(reads.begin(), reads.end(), r) != reads.end()) {
+                    depend(reader, i);
+                }
+            }
+        }
+    }
+
+    // in the order they were added wherever the dependencies allow it (ready is a min-heap)
+    ready.clear();
+    for (int i = 0; i < n; i++) {
+        if (needed[i] && waiting[i] == 0) {
+            ready.push_back(i);
+            std::push_heap(ready.begin(), ready.end(), std::greater<int>());
+        }
+    }
+    ordered.clear();
+    while (!ready.empty()) {
+        std::pop_heap(ready.begin(), ready.end(), std::greater<int>());
+        int i = ready.back();
+        ready.pop_back();
+        ordered.push_back(i);
+        for (int then : after[i]) {
+            if (--waiting[then] == 0) {
+                ready.push_back(then);
+                std::push_heap(ready.begin(), ready.end(), std::greater<int>());
+            }
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        if (needed[i] && waiting[i] > 0) {
+            std::cout << "Render graph: " << pass_list[i].name << " depends on itself, running it last" << std::endl;
+            ordered.push_back(i);
+        }
+    }
+}
+
+void RenderGraph::execute() {
+    frame++;
+    schedule();
+    passes = (int)ordered.size();
+    culled = pass_count - passes;
+    order.clear();
+
+    // lifetimes of the textures, in execution order
+    for (int i = 0; i < (int)ordered.size(); i++) {
+        Pass &pass = pass_list[ordered[i]];
+        for (const std::vector<RenderResource> *used : {&pass.reads, &pass.inputs}) {
+            for (RenderResource r : *used) {
+                Resource &resource = resources[versions[r].resource];
+                if (resource.first_use < 0) {
+                    resource.first_use = i;
+                }
+                resource.last_use = i;
+            }
+        }
+    }
+
+    // transient textures are taken from the pool just before their first use and handed back after their last,
+    // so a later one with the same description can reuse the memory within the frame
+    for (int i = 0; i < (int)ordered.size(); i++) {
+        for (Resource &resource : resources) {
+            if (!resource.imported && resource.first_use == i) {
+                allocate(resource);
+            }
+        }
+        run(pass_list[ordered[i]]);
+        for (Resource &resource : resources) {
+            if (resource.pool >= 0 && resource.last_use == i) {
+                pool[resource.pool].busy = false;
+            }
+        }
+    }
+
+    trim();
+    GlState::get().bind_framebuffer(GL_FRAMEBUFFER, window_framebuffer);
+    glViewport(0, 0, window_width, window_height);
+}
+
+void RenderGraph::allocate(Resource &resource) {
+    const TextureDesc &desc = resource.desc;
+    for (int i = 0; i < (int)pool.size(); i++) {
+        const TextureDesc &other = pool[i].desc;
+        if (!pool[i].busy && other.width == desc.width && other.height == desc.height && other.depth == desc.depth && other.format == desc.format) {
+            resource.pool = i;
+            break;
+        }
+    }
+    if (resource.pool < 0) {
+        // created without binding anything, this runs between passes
+        unsigned int texture;
+        if (desc.depth > 1) {
+            glCreateTextures(GL_TEXTURE_3D, 1, &texture);
+            glTextureStorage3D(texture, 1, desc.format, desc.width, desc.height, desc.depth);
+            glTextureParameteri(texture, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        } else {
+            glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+            glTextureStorage2D(texture, 1, desc.format, desc.width, desc.height);
+        }
+        GLenum filter = is_depth(desc.format) ? GL_NEAREST : GL_LINEAR;
+        glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, filter);
+        glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, filter);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        pool.push_back({desc, GlTexture(texture), frame, false, TrackedBytes(MEMORY_RENDER_TARGET)});
+        pool.back().tracked.set((size_t)desc.width * desc.height * desc.depth * texel_size(desc.format));
+        resource.pool = (int)pool.size() - 1;
+    }
+    pool[resource.pool].busy = true;
+    pool[resource.pool].last_used = frame;
+    resource.texture = pool[resource.pool].texture;
+}
+
+void RenderGraph::run(Pass &pass) {
+    if (!pass.attachments.empty()) {
+        std::vector<unsigned int> &textures = attached;
+        std::vector<bool> &depth = attached_depth;
+        textures.clear();
+        depth.clear();
+        bool window = false;
+        glm::ivec2 extent(0);
+        for (const Pass::Attachment &attachment : pass.attachments) {
+            const Resource &resource = resources[versions[attachment.version].resource];
+            window = window || resource.is_backbuffer;
+            textures.push_back(resource.texture);
+            depth.push_back(is_depth(resource.desc.format));
+            extent = glm::ivec2(resource.desc.width, resource.desc.height);
+        }
+        GlState::get().bind_framebuffer(GL_FRAMEBUFFER, window ? window_framebuffer : framebuffer(textures, depth));
+        glViewport(0, 0, extent.x, extent.y);
+
+        // what the pass asks to have cleared, and transient targets on their first write
+        int colour = 0;
+        for (int i = 0; i < (int)pass.attachments.size(); i++) {
+            const Pass::Attachment &attachment = pass.attachments[i];
+            const Resource &resource = resources[versions[attachment.version].resource];
+            bool undefined = !resource.imported && versions[attachment.from].producer < 0;
+            if (attachment.load == CLEAR || (attachment.load == LOAD && undefined)) {
+                GlState::get().disable(GL_SCISSOR_TEST);
+                if (depth[i]) {
+                    float one = 1;
+                    glClearBufferfv(GL_DEPTH, 0, &one);
+                } else {
+                    glClearBufferfv(GL_COLOR, colour, &attachment.clear[0]);
+                }
+            }
+            colour += depth[i] ? 0 : 1;
+        }
+    }
+    pass.call(pass.closure);
+    order.push_back(pass.name);
+}
+
+unsigned int RenderGraph::framebuffer(const std::vector<unsigned int> &textures, const std::vector<bool> &depth) {
+    auto found = framebuffers.find(textures);
+    if (found != framebuffers.end()) {
+        return found->second;
+    }
+
+    // built without binding it, passes ask for these while their own framebuffer is bound
+    unsigned int fbo;
+    glCreateFramebuffers(1, &fbo);
+    std::vector<GLenum> draw_buffers;
+    for (int i = 0; i < (int)textures.size(); i++) {
+        if (depth[i]) {
+            glNamedFramebufferTexture(fbo, GL_DEPTH_ATTACHMENT, textures[i], 0);
+        } else {
+            glNamedFramebufferTexture(fbo, GL_COLOR_ATTACHMENT0 + (GLenum)draw_buffers.size(), textures[i], 0);
+            draw_buffers.push_back(GL_COLOR_ATTACHMENT0 + (GLenum)draw_buffers.size());
+        }
+    }
+    if (draw_buffers.empty()) {
+        glNamedFramebufferDrawBuffer(fbo, GL_NONE);
+        glNamedFramebufferReadBuffer(fbo, GL_NONE);
+    } else {
+        glNamedFramebufferDrawBuffers(fbo, (GLsizei)draw_buffers.size(), draw_buffers.data());
+    }
+    GLenum status = glCheckNamedFramebufferStatus(fbo, GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "Framebuffer is not complete: " << status << std::endl;
+    }
+    framebuffers[textures] = GlFramebuffer(fbo);
+    return fbo;
+}
+
+unsigned int RenderGraph::texture(RenderResource r) {
+    return resources[versions[r].resource].texture;
+}
+
+unsigned int RenderGraph::read_framebuffer(RenderResource r) {
+    const Resource &resource = resources[versions[r].resource];
+    if (resource.is_backbuffer) {
+        return window_framebuffer;
+    }
+    read_attached.assign(1, resource.texture);
+    read_attached_depth.assign(1, is_depth(resource.desc.format));
+    return framebuffer(read_attached, read_attached_depth);
+}
+
+glm::ivec2 RenderGraph::size(RenderResource r) {
+    const TextureDesc &desc = resources[versions[r].resource].desc;
+    return glm::ivec2(desc.width, desc.height);
+}
+
+void RenderGraph::trim() {
+    pooled_bytes = 0;
+    for (int i = (int)pool.size() - 1; i >= 0; i--) {
+        PooledTexture &pooled = pool[i];
+        if (frame - pooled.last_used <= RENDER_GRAPH_POOL_FRAMES) {
+            pooled_bytes += pooled.tracked.get();
+            continue;
+        }
+        for (auto it = framebuffers.begin(); it != framebuffers.end();) {
+            if (std::find(it->first.begin(), it->first.end(), pooled.texture) != it->first.end()) {
+                it = framebuffers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        pool.erase(pool.begin() + i);
+    }
+    pooled_textures = (int)pool.size();
+}
+
+void RenderGraph::release() {
+    framebuffers.clear();
+    pool.clear();
+    pooled_textures = 0;
+    pooled_bytes = 0;
+}
+
+bool RenderGraph::is_depth(GLenum format) {
+    return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F || format == GL_DEPTH24_STENCIL8;
+}
+
+size_t RenderGraph::texel_size(GLenum format) {
+    switch (format) {
+    case GL_RGBA16F:
+        return 8;
+    case GL_RGBA32F:
+        return 16;
+    case GL_R8:
+        return 1;
+    case GL_RG8:
+    case GL_R16F:
+        return 2;
+    }
+    return 4;
+}
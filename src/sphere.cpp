@@ -1,5 +1,8 @@
 #include "sphere.h"
 
+#include "artifact_cache.h"
+#include "gl_state.h"
+
 Sphere::Sphere(float radius, int squares_per_row, bool project) : radius(radius), squares_per_row(squares_per_row), is_project(project) {
     int hori_verts = (squares_per_row + 1) * squares_per_row * 4;
     int cover_verts = (squares_per_row - 1) * (squares_per_row - 1) * 2;
@@ -47,14 +50,13 @@ void Sphere::project(bool project) {
 }
 
 void Sphere::draw(const glm::mat4 &vp) {
-    glBindVertexArray(vao);
+    GlState::get().bind_vertex_array(vao);
     sphere_shader.use();
     sphere_shader.set_matrix4("vp", vp);
     sphere_shader.set_float("radius", radius);
     sphere_shader.set_matrix4("model", model);
     sphere_shader.set_vector3("colour", colour);
-    glDrawElements(GL_TRIANGLES, (int)indices.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    glDrawElements(GL_TRIANGLES, total_indices, GL_UNSIGNED_INT, 0);
 }
 
 int Sphere::get_verts() {
@@ -69,11 +71,52 @@ float Sphere::get_radius() {
     return radius;
 }
 
+float Sphere::get_scale() {
+    return model[0][0];
+}
+
 int Sphere::get_segments() {
     return squares_per_row;
 }
 
 void Sphere::build_vertices() {
+    // the mesh only depends on the radius and the number of squares, so it is generated once and then
+    // uploaded straight from the cached copy, laid out as the two counts, the vertices and the indices
+    CacheKey key("sphere mesh");
+    key.add(radius).add(squares_per_row);
+    std::shared_ptr<const Artifact> mesh = ArtifactCache::get().find(key);
+    if (!mesh) {
+        generate_mesh();
+        uint32_t counts[2] = {(uint32_t)vertices.size(), (uint32_t)indices.size()};
+        mesh = ArtifactCache::get().store(key, {{counts, sizeof(counts)},
+                                                {vertices.data(), sizeof(float) * vertices.size()},
+                                                {indices.data(), sizeof(unsigned int) * indices.size()}});
+        clear_arrays();
+    }
+    const uint32_t *counts = (const uint32_t *)mesh->data();
+    const float *mesh_vertices = (const float *)(counts + 2);
+    const unsigned int *mesh_indices = (const unsigned int *)(mesh_vertices + counts[0]);
+
+    // set the total number of indices to draw
+    total_indices = (int)counts[1];
+
+    // rebuilds write over the buffers already there, which only grow when the new mesh is bigger
+    vbo.upload(mesh_vertices, sizeof(float) * counts[0]);
+    ebo.upload(mesh_indices, sizeof(unsigned int) * counts[1]);
+
+    // and keep their names when they do, so the vertex array is only set up once
+    if (!vao) {
+        vao = GlVertexArray::generate();
+        GlState::get().bind_vertex_array(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        GlState::get().bind_vertex_array(0);
+    }
+}
+
+void Sphere::generate_mesh() {
     // ensure that the arrays are empty
     clear_arrays();
 
@@ -237,22 +280,6 @@ void Sphere::build_vertices() {
             add_triangle(btm_map[i3], btm_map[i4], btm_map[i2]);
         }
     }
-
-    // set the total number of indices to draw
-    total_indices = (int)indices.size();
-
-    // build the opengl buffers
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-    glGenBuffers(1, &ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(), indices.data(), GL_STATIC_DRAW);
-    glBindVertexArray(0);
 }
 
 void Sphere::add_vertex(glm::vec3 point) {
@@ -269,6 +296,5 @@ void Sphere::add_triangle(int i1, int i2, int i3) {
 
 void Sphere::clear_arrays() {
     std::vector<float>().swap(vertices);
-    std::vector<float>().swap(normals);
     std::vector<unsigned int>().swap(indices);
 }
\ No newline at end of file
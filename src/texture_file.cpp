@@ -0,0 +1,240 @@
+#include "texture_file.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "artifact_cache.h"
+
+static const unsigned char KTX_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+static const uint32_t KTX_ENDIANNESS = 0x04030201;
+
+struct KtxHeader {
+    unsigned char identifier[12];
+    uint32_t endianness;
+    uint32_t gl_type;
+    uint32_t gl_type_size;
+    uint32_t gl_format;
+    uint32_t gl_internal_format;
+    uint32_t gl_base_internal_format;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t array_elements;
+    uint32_t faces;
+    uint32_t mip_levels;
+    uint32_t key_value_bytes;
+};
+
+std::string compressed_texture_path(const std::string &image_path) {
+    size_t dot = image_path.find_last_of('.');
+    size_t slash = image_path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return image_path + ".ktx";
+    }
+    return image_path.substr(0, dot) + ".ktx";
+}
+
+// one BC4 block: two endpoints and a 3-bit index per texel into the eight values between them
+static void encode_bc4(const unsigned char values[16], unsigned char *block) {
+    unsigned char high = *std::max_element(values, values + 16);
+    unsigned char low = *std::min_element(values, values + 16);
+    block[0] = high;
+    block[1] = low;
+
+    // with the first endpoint above the second, index 0 is high, 1 is low and 2 to 7 step from high to low
+    uint64_t indices = 0;
+    for (int i = 0; i < 16; i++) {
+        int step = high == low ? 0 : (int)std::lround((high - values[i]) * 7.0f / (high - low));
+        uint64_t index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+        indices |= index << (3 * i);
+    }
+    for (int i = 0; i < 6; i++) {
+        block[2 + i] = (unsigned char)(indices >> (8 * i));
+    }
+}
+
+// BC5 is a BC4 block of the red channel followed by one of the green, for each 4x4 texels (clamped at the edges)
+static std::vector<unsigned char> encode_bc5(const std::vector<unsigned char> &rg, int width, int height) {
+    int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+    std::vector<unsigned char> blocks((size_t)blocks_x * blocks_y * 16);
+    unsigned char *block = blocks.data();
+    for (int by = 0; by < blocks_y; by++) {
+        for (int bx = 0; bx < blocks_x; bx++) {
+            unsigned char red[16], green[16];
+            for (int i = 0; i < 16; i++) {
+                int x = std::min(bx * 4 + (i & 3), width - 1);
+                int y = std::min(by * 4 + (i >> 2), height - 1);
+                red[i] = rg[((size_t)y * width + x) * 2];
+                green[i] = rg[((size_t)y * width + x) * 2 + 1];
+            }
+            encode_bc4(red, block);
+            encode_bc4(green, block + 8);
+            block += 16;
+        }
+    }
+    return blocks;
+}
+
+static std::vector<unsigned char> pack_rg(const std::vector<glm::vec3> &normals) {
+    std::vector<unsigned char> rg(normals.size() * 2);
+    for (size_t i = 0; i < normals.size(); i++) {
+        rg[i * 2] = (unsigned char)std::lround(glm::clamp(normals[i].x * 0.5f + 0.5f, 0.0f, 1.0f) * 255.0f);
+        rg[i * 2 + 1] = (unsigned char)std::lround(glm::clamp(normals[i].y * 0.5f + 0.5f, 0.0f, 1.0f) * 255.0f);
+    }
+    return rg;
+}
+
+bool write_normal_map(const std::string &path, const unsigned char *pixels, int width, int height, int channels) {
+    std::vector<glm::vec3> normals((size_t)width * height);
+    for (size_t i = 0; i < normals.size(); i++) {
+        const unsigned char *p = pixels + i * channels;
+        glm::vec3 n = glm::vec3(p[0], p[1], p[2]) / 255.0f * 2.0f - 1.0f;
+        normals[i] = glm::length(n) > 0 ? glm::normalize(n) : glm::vec3(0, 0, 1);
+    }
+
+    std::vector<std::vector<unsigned char>> levels;
+    int w = width, h = height;
+    while (true) {
+        levels.push_back(encode_bc5(pack_rg(normals), w, h));
+        if (w == 1 && h == 1) {
+            break;
+        }
+
+        // average each 2x2 (the last row or column of an odd size folds into its neighbour) and renormalise
+        int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+        std::vector<glm::vec3> next((size_t)nw * nh);
+        for (int y = 0; y < nh; y++) {
+            for (int x = 0; x < nw; x++) {
+                glm::vec3 sum(0);
+                for (int i = 0; i < 4; i++) {
+                    int sx = std::min(x * 2 + (i & 1), w - 1);
+                    int sy = std::min(y * 2 + (i >> 1), h - 1);
+                    sum += normals[(size_t)sy * w + sx];
+                }
+                next[(size_t)y * nw + x] = glm::length(sum) > 0 ? glm::normalize(sum) : glm::vec3(0, 0, 1);
+            }
+        }
+        normals.swap(next);
+        w = nw;
+        h = nh;
+    }
+
+    KtxHeader header = {};
+    memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+    header.endianness = KTX_ENDIANNESS;
+    header.gl_type_size = 1;
+    header.gl_internal_format = GL_COMPRESSED_RG_RGTC2;
+    header.gl_base_internal_format = GL_RG;
+    header.pixel_width = width;
+    header.pixel_height = height;
+    header.faces = 1;
+    header.mip_levels = (uint32_t)levels.size();
+
+    // blocks are 16 bytes, so every level already ends on the 4-byte boundary the format asks for
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char *)&header, sizeof(header));
+    for (const auto &level : levels) {
+        uint32_t size = (uint32_t)level.size();
+        file.write((const char *)&size, sizeof(size));
+        file.write((const char *)level.data(), level.size());
+    }
+    if (!file) {
+        std::cout << "Failed to write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int TextureData::storage_levels() const {
+    if (!generate_mipmaps) {
+        return (int)levels.size();
+    }
+    int levels = 1;
+    for (int size = std::max(this->levels[0].width, this->levels[0].height); size > 1; size /= 2) {
+        levels++;
+    }
+    return levels;
+}
+
+// the levels of a BC5 2d KTX file, false if it is missing or not one we can use (the source image is used instead)
+static bool read_ktx(const std::string &path, TextureData &data) {
+    std::shared_ptr<Artifact> file = Artifact::map(path, sizeof(KtxHeader));
+    if (!file) {
+        return false;
+    }
+    const KtxHeader *header = (const KtxHeader *)file->data();
+    if (memcmp(header->identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0 || header->endianness != KTX_ENDIANNESS ||
+        header->gl_type != 0 || header->gl_internal_format != GL_COMPRESSED_RG_RGTC2 || header->faces != 1 || header->array_elements != 0 ||
+        header->pixel_depth != 0 || header->pixel_width == 0 || header->pixel_height == 0 || header->mip_levels == 0) {
+        std::cout << "Unsupported texture file " << path << std::endl;
+        return false;
+    }
+
+    data.levels.clear();
+    size_t offset = sizeof(KtxHeader) + header->key_value_bytes;
+    int w = header->pixel_width, h = header->pixel_height;
+    for (uint32_t level = 0; level < header->mip_levels; level++) {
+        uint32_t size;
+        if (offset + sizeof(size) > file->size()) {
+            std::cout << "Truncated texture file " << path << std::endl;
+            return false;
+        }
+        memcpy(&size, file->data() + offset, sizeof(size));
+        offset += sizeof(size);
+        if (offset + size > file->size()) {
+            std::cout << "Truncated texture file " << path << std::endl;
+            return false;
+        }
+        // 16 bytes per 4x4 block
+        int rows = (h + 3) / 4;
+        if (size != (uint32_t)((w + 3) / 4 * rows * 16)) {
+            std::cout << "Unexpected level size in texture file " << path << std::endl;
+            return false;
+        }
+        data.levels.push_back({w, h, offset, size, size / rows, rows});
+        offset += (size + 3) & ~3u;
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+    }
+
+    // fault the pages in here rather than on whichever thread uploads them
+    volatile unsigned char sink = 0;
+    for (size_t i = 0; i < file->size(); i += 4096) {
+        sink += file->data()[i];
+    }
+
+    data.source = file;
+    data.internal_format = header->gl_internal_format;
+    data.format = 0;
+    data.type = 0;
+    data.generate_mipmaps = false;
+    return true;
+}
+
+bool read_texture(const std::string &image_path, TextureData &data) {
+    if (read_ktx(compressed_texture_path(image_path), data)) {
+        return true;
+    }
+
+    int w, h;
+    std::shared_ptr<const Artifact> image = ArtifactCache::get().load_image(image_path, 3, w, h);
+    if (!image) {
+        return false;
+    }
+    size_t offset = ArtifactCache::image_pixels(*image) - image->data();
+    data.source = image;
+    data.internal_format = GL_RGB8;
+    data.format = GL_RGB;
+    data.type = GL_UNSIGNED_BYTE;
+    data.levels = {{w, h, offset, (size_t)w * h * 3, (size_t)w * 3, h}};
+    data.generate_mipmaps = true;
+    return true;
+}
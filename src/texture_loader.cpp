@@ -0,0 +1,167 @@
+#include "texture_loader.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#include "gl_state.h"
+#include "profiler.h"
+
+TextureLoader &TextureLoader::get() {
+    static TextureLoader loader;
+    return loader;
+}
+
+std::shared_ptr<StreamedTexture> TextureLoader::load(const std::string &image_path, glm::u8vec4 placeholder) {
+    std::shared_ptr<StreamedTexture> texture = std::make_shared<StreamedTexture>();
+    texture->path = image_path;
+    texture->id = GlTexture::generate();
+    GlState::get().bind_texture(GL_TEXTURE_2D, texture->id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &placeholder[0]);
+    GlState::get().bind_texture(GL_TEXTURE_2D, 0);
+    texture->tracked.set(4);
+
+    if (!readers) {
+        readers = std::make_unique<ThreadPool>();
+    }
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->texture = texture;
+    outstanding++;
+    readers->submit([this, job, image_path] {
+        job->failed = !read_texture(image_path, job->data);
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.push_back(job);
+    });
+    return texture;
+}
+
+void TextureLoader::update() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ready.empty() && uploading.empty()) {
+            return;
+        }
+        uploading.insert(uploading.end(), ready.begin(), ready.end());
+        ready.clear();
+    }
+
+    ProfileScope scope("texture uploads");
+    auto start = std::chrono::steady_clock::now();
+    if (!pbo) {
+        pbo = GlBuffer::generate();
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // at least one chunk a frame, so a tight budget still gets there
+    do {
+        Job &job = *uploading.front();
+        if (job.failed || upload_chunk(job)) {
+            complete(job);
+            uploading.pop_front();
+        }
+    } while (!uploading.empty() && std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() < budget_ms);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    GlState::get().bind_texture(GL_TEXTURE_2D, 0);
+}
+
+void TextureLoader::finish() {
+    if (readers) {
+        readers->wait();
+    }
+    float budget = budget_ms;
+    budget_ms = 1e9f;
+    update();
+    budget_ms = budget;
+}
+
+int TextureLoader::pending() {
+    return outstanding;
+}
+
+bool TextureLoader::upload_chunk(Job &job) {
+    const TextureData &data = job.data;
+    if (!job.id) {
+        // the real texture is built next to the placeholder and only swapped in once it is complete
+        job.id = GlTexture::generate();
+        GlState::get().bind_texture(GL_TEXTURE_2D, job.id);
+        glTexStorage2D(GL_TEXTURE_2D, data.storage_levels(), data.internal_format, data.levels[0].width, data.levels[0].height);
+    }
+    GlState::get().bind_texture(GL_TEXTURE_2D, job.id);
+
+    // as many whole rows as fit in a chunk, copied into a fresh (orphaned) buffer so the copy never waits
+    // for the gpu to finish with the last one
+    const TextureData::Level &level = data.levels[job.level];
+    int rows = std::min(level.rows - job.row, std::max(1, (int)(chunk_size / level.row_size)));
+    size_t size = rows * level.row_size;
+    if (job.row + rows == level.rows) {
+        size = level.size - job.row * level.row_size;
+    }
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    pbo_bytes.set(size);
+    void *staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!staging) {
+        std::cout << "Failed to map the upload buffer for " << job.texture->path << std::endl;
+        job.failed = true;
+        return true;
+    }
+    memcpy(staging, data.source->data() + level.offset + job.row * level.row_size, size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    if (data.is_compressed()) {
+        // rows of 4x4 blocks
+        int y = job.row * 4;
+        int height = std::min(rows * 4, level.height - y);
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, job.level, 0, y, level.width, height, data.internal_format, (GLsizei)size, (void *)0);
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, job.level, 0, job.row, level.width, rows, data.format, data.type, (void *)0);
+    }
+    uploaded_bytes += size;
+
+    job.row += rows;
+    if (job.row == level.rows) {
+        job.row = 0;
+        job.level++;
+    }
+    return job.level == (int)data.levels.size();
+}
+
+void TextureLoader::complete(Job &job) {
+    outstanding--;
+    StreamedTexture &texture = *job.texture;
+    if (job.failed) {
+        std::cout << "Failed to load " << texture.path << std::endl;
+        job.id.reset();
+        job.data.source = nullptr;
+        return;
+    }
+
+    GlState::get().bind_texture(GL_TEXTURE_2D, job.id);
+    if (job.data.generate_mipmaps) {
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    texture.id = std::move(job.id);
+    texture.ready = true;
+
+    // the driver's mips add a third on top of the levels that were uploaded
+    size_t bytes = 0;
+    for (const TextureData::Level &level : job.data.levels) {
+        bytes += level.size;
+    }
+    texture.tracked.set(job.data.generate_mipmaps ? bytes * 4 / 3 : bytes);
+    job.data.source = nullptr;
+    loaded++;
+}
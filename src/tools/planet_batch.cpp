@@ -0,0 +1,334 @@
+// headless batch renderer, renders every planet variant in a json list to a png
+//
+// usage: planet_batch --list variants.json [--out-dir thumbnails] [--width w] [--height h]
+//                     [--threads n] [--path fragment|compute|froxel] [--egl]
+//
+// the list holds the shared camera, sun and base parameters, explicit variants and linear sweeps:
+//   {"camera": [0, 0, 4], "target": [0, 0, 0], "sun": [30, 0, 0], "time": 0, "segments": 512,
+//    "base": {"noise_mult": 0.25},
+//    "variants": [{"name": "desert", "ocean_radius": 0.9}],
+//    "sweeps": [{"name": "ocean", "param": "ocean_radius", "from": 0.95, "to": 1.05, "count": 16}]}
+// parameters use the names of PlanetParams::for_each_param
+//
+// frames are read back without stalling and compressed to png on worker threads while the gpu renders
+// the next variant
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "frame_capture.h"
+#include "gl_handle.h"
+#include "gl_state.h"
+#include "json.h"
+#include "light.h"
+#include "planet.h"
+#include "postprocess.h"
+#include "render_graph.h"
+#include "texture_loader.h"
+
+struct BatchSettings {
+    std::string list;
+    std::string out_dir = "thumbnails";
+    int width = 256, height = 256;
+    int threads = 0;
+    PostProcessPath path = FRAGMENT_PATH;
+    bool egl = false;
+};
+
+struct Variant {
+    std::string name;
+    PlanetParams params;
+};
+
+static bool read_value(const JsonValue &json, float &value) {
+    if (json.type != JsonValue::NUMBER) {
+        return false;
+    }
+    value = (float)json.number;
+    return true;
+}
+
+static bool read_value(const JsonValue &json, int &value) {
+    if (json.type != JsonValue::NUMBER) {
+        return false;
+    }
+    value = (int)std::lround(json.number);
+    return true;
+}
+
+// glm vectors are read from arrays of the same length
+template <typename T>
+static bool read_value(const JsonValue &json, T &value) {
+    if (json.type != JsonValue::ARRAY || (int)json.array.size() != value.length()) {
+        return false;
+    }
+    for (int i = 0; i < value.length(); i++) {
+        if (json.array[i].type != JsonValue::NUMBER) {
+            return false;
+        }
+        value[i] = (float)json.array[i].number;
+    }
+    return true;
+}
+
+template <typename T>
+static T lerp(T a, T b, float t) {
+    return a + (b - a) * t;
+}
+
+static int lerp(int a, int b, float t) {
+    return (int)std::lround(a + (b - a) * t);
+}
+
+// set a parameter by name, false if there is no such parameter or the value does not fit it
+static bool set_param(PlanetParams &params, const std::string &name, const JsonValue &json) {
+    bool found = false, ok = false;
+    params.for_each_param([&](const char *param, auto &value) {
+        if (name == param) {
+            found = true;
+            ok = read_value(json, value);
+        }
+    });
+    if (!ok) {
+        std::cout << (found ? "Bad value for " : "Unknown parameter ") << name << std::endl;
+    }
+    return ok;
+}
+
+// set a parameter to from + (to - from) * t
+static bool sweep_param(PlanetParams &params, const std::string &name, const JsonValue &from, const JsonValue &to, float t) {
+    bool found = false, ok = false;
+    params.for_each_param([&](const char *param, auto &value) {
+        if (name == param) {
+            auto a = value, b = value;
+            found = true;
+            ok = read_value(from, a) && read_value(to, b);
+            value = lerp(a, b, t);
+        }
+    });
+    if (!ok) {
+        std::cout << (found ? "Bad range for " : "Unknown parameter ") << name << std::endl;
+    }
+    return ok;
+}
+
+static bool read_variants(const JsonValue &list, std::vector<Variant> &variants) {
+    PlanetParams base;
+    if (const JsonValue *json = list.get("base")) {
+        for (const auto &member : json->object) {
+            if (!set_param(base, member.first, member.second)) {
+                return false;
+            }
+        }
+    }
+
+    if (const JsonValue *json = list.get("variants")) {
+        for (const JsonValue &entry : json->array) {
+            Variant variant = {entry.get_string("name", "variant_" + std::to_string(variants.size())), base};
+            for (const auto &member : entry.object) {
+                if (member.first != "name" && !set_param(variant.params, member.first, member.second)) {
+                    return false;
+                }
+            }
+            variants.push_back(variant);
+        }
+    }
+
+    if (const JsonValue *json = list.get("sweeps")) {
+        for (const JsonValue &sweep : json->array) {
+            std::string param = sweep.get_string("param");
+            std::string name = sweep.get_string("name", param);
+            const JsonValue *from = sweep.get("from");
+            const JsonValue *to = sweep.get("to");
+            int count = (int)sweep.get_number("count", 2);
+            if (!from || !to || count < 1) {
+                std::cout << "Sweep " << name << " needs a from, a to and a count" << std::endl;
+                return false;
+            }
+            for (int i = 0; i < count; i++) {
+                char suffix[16];
+                snprintf(suffix, sizeof(suffix), "_%03d", i);
+                Variant variant = {name + suffix, base};
+                if (!sweep_param(variant.params, param, *from, *to, count > 1 ? (float)i / (count - 1) : 0)) {
+                    return false;
+                }
+                variants.push_back(variant);
+            }
+        }
+    }
+    return true;
+}
+
+static glm::vec3 read_vec3(const JsonValue &list, const char *key, glm::vec3 fallback) {
+    const JsonValue *json = list.get(key);
+    if (json && !read_value(*json, fallback)) {
+        std::cout << "Expected [x, y, z] for " << key << std::endl;
+    }
+    return fallback;
+}
+
+static bool parse_args(int argc, char **argv, BatchSettings &settings) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--egl") {
+            settings.egl = true;
+        } else if (arg == "--list" && has_value) {
+            settings.list = argv[++i];
+        } else if (arg == "--out-dir" && has_value) {
+            settings.out_dir = argv[++i];
+        } else if (arg == "--width" && has_value) {
+            settings.width = atoi(argv[++i]);
+        } else if (arg == "--height" && has_value) {
+            settings.height = atoi(argv[++i]);
+        } else if (arg == "--threads" && has_value) {
+            settings.threads = atoi(argv[++i]);
+        } else if (arg == "--path" && has_value) {
+            std::string path = argv[++i];
+            settings.path = path == "compute" ? TILED_COMPUTE_PATH : path == "froxel" ? FROXEL_PATH : FRAGMENT_PATH;
+        } else {
+            std::cout << "Unknown argument " << arg << std::endl;
+            return false;
+        }
+    }
+    if (settings.list.empty()) {
+        std::cout << "A variant list is needed (--list variants.json)" << std::endl;
+        return false;
+    }
+    if (settings.width <= 0 || settings.height <= 0) {
+        std::cout << "Width and height have to be positive" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    BatchSettings settings;
+    if (!parse_args(argc, argv, settings)) {
+        return 2;
+    }
+
+    JsonValue list;
+    std::vector<Variant> variants;
+    if (!load_json(settings.list, list) || !read_variants(list, variants)) {
+        std::cout << "Failed to read variants from " << settings.list << std::endl;
+        return 2;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(settings.out_dir, error);
+    if (error) {
+        std::cout << "Failed to create " << settings.out_dir << std::endl;
+        return 2;
+    }
+
+    // an invisible window is enough for a context, with an osmesa build of glfw there is no display involved at all
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    if (settings.egl) {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    }
+    GLFWwindow *window = glfwCreateWindow(settings.width, settings.height, "Procedural Planet Batch", NULL, NULL);
+    if (window == NULL) {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return 2;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        std::cout << "Failed to initialise GLAD" << std::endl;
+        glfwTerminate();
+        return 2;
+    }
+
+    glm::vec3 camera_pos = read_vec3(list, "camera", glm::vec3(0, 0, 4));
+    glm::vec3 target = read_vec3(list, "target", glm::vec3(0));
+    Camera camera(camera_pos, glm::vec3(0, 1, 0), glm::vec3(0, 0, -1));
+    if (target != camera_pos) {
+        camera.look_at(camera_pos, target);
+    }
+    float time = (float)list.get_number("time", 0);
+
+    // the default framebuffer of a hidden window has undefined contents, so frames are presented into a
+    // texture of our own and captured from there
+    unsigned int texture, fbo;
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+    GlTexture frame_texture(texture);
+    glTextureStorage2D(frame_texture, 1, GL_RGBA8, settings.width, settings.height);
+    glCreateFramebuffers(1, &fbo);
+    GlFramebuffer frame_fbo(fbo);
+    glNamedFramebufferTexture(frame_fbo, GL_COLOR_ATTACHMENT0, frame_texture, 0);
+    if (glCheckNamedFramebufferStatus(frame_fbo, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "Failed to create the frame buffer" << std::endl;
+        glfwTerminate();
+        return 2;
+    }
+
+    PostProcess post(settings.width, settings.height);
+    post.path = settings.path;
+    RenderGraph graph;
+    Planet planet(1, (int)list.get_number("segments", 512));
+    Light sun(0.5f, 8, read_vec3(list, "sun", glm::vec3(30, 0, 0)));
+    TextureLoader::get().finish();
+
+    // frames are read back through a ring of pixel buffers and compressed on the capture's threads,
+    // so the readback and the png encoding of one variant overlap rendering the next ones
+    FrameCapture capture(settings.threads);
+
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+    double submit_ms = 0;
+
+    glm::mat4 vp = camera.get_projection((float)settings.width / (float)settings.height) * camera.get_view();
+    for (Variant &variant : variants) {
+        auto submit_start = Clock::now();
+        (PlanetParams &)planet = variant.params;
+
+        float rt = post.begin_frame(planet, camera, sun, time);
+        RenderResource colour, depth;
+        graph.begin(settings.width, settings.height, frame_fbo);
+        post.add_scene_targets(graph, colour, depth);
+        RenderGraph::Pass &scene = graph.add_pass("scene", [&] {
+            GlState::get().enable(GL_DEPTH_TEST);
+            planet.draw(vp, camera.get_position(), sun);
+            sun.draw(vp);
+        });
+        colour = scene.attach(colour, CLEAR, glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
+        depth = scene.attach(depth, CLEAR);
+        post.add_passes(graph, colour, depth, planet, camera, sun, rt);
+        graph.execute();
+
+        capture.screenshot((std::filesystem::path(settings.out_dir) / (variant.name + ".png")).string());
+        capture.capture(frame_fbo, settings.width, settings.height);
+        submit_ms += std::chrono::duration<double, std::milli>(Clock::now() - submit_start).count();
+    }
+    capture.flush();
+
+    double total_s = std::chrono::duration<double>(Clock::now() - start).count();
+    int count = (int)variants.size();
+    std::cout << "Rendered " << count << " planets at " << settings.width << "x" << settings.height << " in " << total_s << " s ("
+              << (total_s > 0 ? count / total_s * 60 : 0) << " planets per minute)" << std::endl;
+    if (count > 0) {
+        std::cout << "  submit " << submit_ms / count << " ms, encode " << capture.average_encode_ms() << " ms per planet, "
+                  << capture.stalls << " readback stalls" << std::endl;
+    }
+
+    frame_fbo.reset();
+    frame_texture.reset();
+    glfwTerminate();
+    return capture.frames_written() < count ? 1 : 0;
+}
@@ -0,0 +1,518 @@
+// headless benchmark, renders scripted scenarios offscreen at a fixed dt and writes the timings as json
+//
+// usage: planet_bench [--scenarios orbit,flyover,...|all] [--frames n] [--sweep-frames n] [--warmup n]
+//                     [--dt seconds] [--width w] [--height h] [--path fragment|compute|froxel]
+//                     [--out results.json] [--baseline results.json] [--tolerance 0.1] [--allocations] [--egl]
+//
+// configure with -DGLFW_USE_OSMESA=ON to run without a display (mesa llvmpipe works)
+// exits with 1 if any scenario regressed against the baseline by more than the tolerance, or with
+// --allocations if a measured frame allocated on the heap
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "alloc_tracker.h"
+#include "camera.h"
+#include "gl_state.h"
+#include "json.h"
+#include "light.h"
+#include "memory_tracker.h"
+#include "planet.h"
+#include "postprocess.h"
+#include "profiler.h"
+#include "render_graph.h"
+#include "texture_loader.h"
+
+// profiler scopes that are reported, in output order
+const char *PASSES[] = {"frame", "terrain draw", "sun draw", "post-process", "uniform upload"};
+const int NUM_PASSES = 5;
+
+// per-frame profiler counters that are reported
+const char *COUNTERS[] = {"gl calls issued", "gl calls skipped", "heap allocations"};
+const int NUM_COUNTERS = 3;
+
+struct BenchSettings {
+    std::vector<std::string> scenarios; // all of them if empty
+    int frames = 240;
+    int sweep_frames = 60;
+    int warmup = 10;
+    float dt = 1.0f / 60;
+    int width = 1600, height = 900;
+    PostProcessPath path = FRAGMENT_PATH;
+    std::string out = "bench_results.json";
+    std::string baseline;
+    float tolerance = 0.1f;
+    bool allocations = false; // count heap allocations, the steady-state frame should have none
+    bool egl = false;
+};
+
+struct Scenario {
+    std::string name;
+    int frames;
+    std::function<void()> setup;
+    std::function<void(float t)> update; // place the camera (and anything else) for time t
+};
+
+struct Summary {
+    float mean, stddev, min, p50, p90, p95, p99, max;
+};
+
+struct ScenarioResult {
+    std::string name;
+    int frames = 0;
+    int dropped = 0; // frames whose gpu times were not ready in time
+    std::vector<float> cpu[NUM_PASSES], gpu[NUM_PASSES];
+    std::vector<float> counts[NUM_COUNTERS];
+    size_t peak_bytes[NUM_MEMORY_TAGS] = {};
+};
+
+static Summary summarise(std::vector<float> samples) {
+    Summary s = {};
+    if (samples.empty()) {
+        return s;
+    }
+    std::sort(samples.begin(), samples.end());
+    int n = (int)samples.size();
+    double total = 0, total_sq = 0;
+    for (float x : samples) {
+        total += x;
+        total_sq += x * x;
+    }
+    auto at = [&](float p) { return samples[std::min(n - 1, (int)(p / 100 * n))]; };
+    s.mean = (float)(total / n);
+    s.stddev = (float)sqrt(std::max(0.0, total_sq / n - s.mean * s.mean));
+    s.min = samples.front();
+    s.p50 = at(50);
+    s.p90 = at(90);
+    s.p95 = at(95);
+    s.p99 = at(99);
+    s.max = samples.back();
+    return s;
+}
+
+static void write_summary(std::ofstream &file, const Summary &s) {
+    file << "{\"mean\": " << s.mean << ", \"stddev\": " << s.stddev << ", \"min\": " << s.min << ", \"p50\": " << s.p50
+         << ", \"p90\": " << s.p90 << ", \"p95\": " << s.p95 << ", \"p99\": " << s.p99 << ", \"max\": " << s.max << "}";
+}
+
+// frame time distribution as a histogram between the fastest and slowest frame
+static void write_histogram(std::ofstream &file, const std::vector<float> &samples) {
+    const int bins = 20;
+    int counts[bins] = {};
+    float lo = samples.empty() ? 0 : *std::min_element(samples.begin(), samples.end());
+    float hi = samples.empty() ? 0 : *std::max_element(samples.begin(), samples.end());
+    float width = std::max(1e-3f, (hi - lo) / bins);
+    for (float x : samples) {
+        counts[std::min(bins - 1, (int)((x - lo) / width))]++;
+    }
+    file << "{\"min\": " << lo << ", \"bin_ms\": " << width << ", \"counts\": [";
+    for (int i = 0; i < bins; i++) {
+        file << (i ? ", " : "") << counts[i];
+    }
+    file << "]}";
+}
+
+static ProfileStat *find_stat(const char *name) {
+    for (ProfileStat &stat : Profiler::get().stats) {
+        if (strcmp(stat.name, name) == 0) {
+            return &stat;
+        }
+    }
+    return nullptr;
+}
+
+static ProfileCounter *find_counter(const char *name) {
+    for (ProfileCounter &counter : Profiler::get().counters) {
+        if (strcmp(counter.name, name) == 0) {
+            return &counter;
+        }
+    }
+    return nullptr;
+}
+
+// copy out the newest frame the profiler has resolved, if it is one of this scenario's
+static void collect(ScenarioResult &result, long long first, long long last, long long &collected) {
+    Profiler &profiler = Profiler::get();
+    long long frame = profiler.frame;
+    if (frame < first || frame > last || frame <= collected) {
+        return;
+    }
+    collected = frame;
+
+    int h = profiler.history_index(frame);
+    ProfileStat *frame_stat = find_stat("frame");
+    if (!frame_stat || frame_stat->gpu_ms[h] <= 0) {
+        result.dropped++;
+        return;
+    }
+    for (int i = 0; i < NUM_PASSES; i++) {
+        ProfileStat *stat = find_stat(PASSES[i]);
+        result.cpu[i].push_back(stat ? stat->cpu_ms[h] : 0);
+        result.gpu[i].push_back(stat ? stat->gpu_ms[h] : 0);
+    }
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        ProfileCounter *counter = find_counter(COUNTERS[i]);
+        result.counts[i].push_back(counter ? counter->values[h] : 0);
+    }
+    result.frames++;
+}
+
+// the same passes as the interactive loop, minus the editor
+static void render_frame(GLFWwindow *window, Planet &planet, Camera &camera, Light &sun, PostProcess &post, RenderGraph &graph, float t, int width, int height) {
+    Profiler &profiler = Profiler::get();
+    profiler.begin_frame();
+
+    sun.update(t);
+    float rt = post.begin_frame(planet, camera, sun, t);
+    glm::mat4 vp = camera.get_projection((float)width / (float)height) * camera.get_view();
+
+    RenderResource colour, depth;
+    graph.begin(width, height);
+    post.add_scene_targets(graph, colour, depth);
+    RenderGraph::Pass &scene = graph.add_pass("scene", [&] {
+        GlState::get().polygon_mode(GL_FILL);
+        GlState::get().enable(GL_DEPTH_TEST);
+
+        profiler.begin("terrain draw", true);
+        planet.draw(vp, camera.get_position(), sun);
+        profiler.end();
+
+        profiler.begin("sun draw", true);
+        sun.draw(vp);
+        profiler.end();
+    });
+    colour = scene.attach(colour, CLEAR, glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
+    depth = scene.attach(depth, CLEAR);
+    post.add_passes(graph, colour, depth, planet, camera, sun, rt);
+    graph.execute();
+
+    profiler.begin("swap");
+    glfwSwapBuffers(window);
+    profiler.end();
+
+    AllocTracker::get().end_frame();
+    GlState::get().end_frame();
+    profiler.end_frame();
+}
+
+static std::vector<Scenario> make_scenarios(Planet &planet, Camera &camera, Light &sun, const BenchSettings &settings) {
+    // every scenario starts from the planet and sun as they were created
+    PlanetParams defaults = planet;
+    int segments = planet.get_segments();
+    glm::vec3 sun_pos = sun.position;
+    auto reset = [=, &planet, &sun]() {
+        (PlanetParams &)planet = defaults;
+        if (planet.get_segments() != segments) {
+            planet.set_squares(segments);
+        }
+        sun.orbiting = false;
+        sun.position = sun_pos;
+        sun.set_position(sun_pos);
+    };
+    auto still = [&camera](float) { camera.look_at(glm::vec3(0, 0.5f, 3), glm::vec3(0)); };
+
+    std::vector<Scenario> scenarios;
+
+    // one full turn around the planet every 8 seconds
+    scenarios.push_back({"orbit", settings.frames, reset, [&camera](float t) {
+                             float a = 2 * PI * t / 8;
+                             camera.look_at(glm::vec3(4 * cos(a), 1, 4 * sin(a)), glm::vec3(0));
+                         }});
+
+    // skimming the surface, looking ahead and slightly down into the atmosphere
+    scenarios.push_back({"flyover", settings.frames, reset, [&camera](float t) {
+                             float a = 0.15f * t;
+                             glm::vec3 pos = glm::normalize(glm::vec3(cos(a), 0.2f, sin(a))) * 1.12f;
+                             glm::vec3 ahead = glm::normalize(glm::vec3(cos(a + 0.2f), 0.1f, sin(a + 0.2f)));
+                             camera.look_at(pos, ahead);
+                         }});
+
+    // standing on the orbit plane of the sun, watching it come up over the horizon
+    scenarios.push_back({"sunrise", settings.frames, [reset, &sun]() {
+                             reset();
+                             sun.orbiting = true;
+                             sun.orbit_period = 24;
+                         },
+                         [&camera](float) {
+                             float a = glm::radians(110.0f);
+                             glm::vec3 up = glm::vec3(cos(a), sin(a), 0);
+                             glm::vec3 horizon = glm::vec3(sin(a), -cos(a), 0);
+                             camera.look_at(up * 1.1f, up * 1.1f + horizon - up * 0.1f);
+                         }});
+
+    // cost of the terrain mesh and noise
+    for (int n : {64, 128, 256, 512, 1024}) {
+        scenarios.push_back({"segments_" + std::to_string(n), settings.sweep_frames, [reset, &planet, n]() {
+                                 reset();
+                                 planet.set_squares(n);
+                             },
+                             still});
+    }
+    for (int n : {2, 4, 8, 12, 16}) {
+        scenarios.push_back({"octaves_" + std::to_string(n), settings.sweep_frames, [reset, &planet, n]() {
+                                 reset();
+                                 planet.octaves = n;
+                             },
+                             still});
+    }
+    return scenarios;
+}
+
+static bool parse_args(int argc, char **argv, BenchSettings &settings) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--egl") {
+            settings.egl = true;
+        } else if (arg == "--scenarios" && has_value) {
+            std::string list = argv[++i];
+            size_t start = 0;
+            while (start <= list.size()) {
+                size_t comma = std::min(list.find(',', start), list.size());
+                std::string name = list.substr(start, comma - start);
+                if (!name.empty() && name != "all") {
+                    settings.scenarios.push_back(name);
+                }
+                start = comma + 1;
+            }
+        } else if (arg == "--frames" && has_value) {
+            settings.frames = atoi(argv[++i]);
+        } else if (arg == "--sweep-frames" && has_value) {
+            settings.sweep_frames = atoi(argv[++i]);
+        } else if (arg == "--warmup" && has_value) {
+            settings.warmup = atoi(argv[++i]);
+        } else if (arg == "--dt" && has_value) {
+            settings.dt = (float)atof(argv[++i]);
+        } else if (arg == "--width" && has_value) {
+            settings.width = atoi(argv[++i]);
+        } else if (arg == "--height" && has_value) {
+            settings.height = atoi(argv[++i]);
+        } else if (arg == "--path" && has_value) {
+            std::string path = argv[++i];
+            settings.path = path == "compute" ? TILED_COMPUTE_PATH : path == "froxel" ? FROXEL_PATH : FRAGMENT_PATH;
+        } else if (arg == "--out" && has_value) {
+            settings.out = argv[++i];
+        } else if (arg == "--baseline" && has_value) {
+            settings.baseline = argv[++i];
+        } else if (arg == "--tolerance" && has_value) {
+            settings.tolerance = (float)atof(argv[++i]);
+        } else if (arg == "--allocations") {
+            settings.allocations = true;
+        } else {
+            std::cout << "Unknown or incomplete argument: " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    BenchSettings settings;
+    if (!parse_args(argc, argv, settings)) {
+        return 2;
+    }
+
+    // an invisible window is enough, with an osmesa build of glfw there is no display involved at all
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    if (settings.egl) {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    }
+    GLFWwindow *window = glfwCreateWindow(settings.width, settings.height, "Procedural Planet Bench", NULL, NULL);
+    if (window == NULL) {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return 2;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        std::cout << "Failed to initialise GLAD" << std::endl;
+        glfwTerminate();
+        return 2;
+    }
+    GlState::get().enable(GL_PROGRAM_POINT_SIZE);
+
+    Camera camera(glm::vec3(0, 0, 10), glm::vec3(0, 1, 0), glm::vec3(0, 0, -1));
+    PostProcess post(settings.width, settings.height);
+    post.path = settings.path;
+    RenderGraph graph;
+    Planet planet(1, 512);
+    Light sun(0.5f, 8, glm::vec3(30, 0, 0));
+
+    // measure the frames with the real textures, not their placeholders
+    TextureLoader::get().finish();
+
+    // a slow frame is measured like any other, rather than written out as a spike
+    Profiler::get().spike_traces = false;
+
+    AllocTracker &allocs = AllocTracker::get();
+    allocs.set_enabled(settings.allocations);
+    bool allocating = false;
+
+    std::vector<ScenarioResult> results;
+    for (Scenario &scenario : make_scenarios(planet, camera, sun, settings)) {
+        if (!settings.scenarios.empty() && std::find(settings.scenarios.begin(), settings.scenarios.end(), scenario.name) == settings.scenarios.end()) {
+            continue;
+        }
+        std::cout << "Running " << scenario.name << std::endl;
+        scenario.setup();
+        MemoryTracker::get().reset_peaks();
+
+        ScenarioResult result;
+        result.name = scenario.name;
+        Profiler &profiler = Profiler::get();
+        long long first = profiler.current_frame() + 1 + settings.warmup;
+        long long last = first + scenario.frames - 1;
+        long long collected = -1;
+        // room for every sample up front, so collecting them is not counted against the frames
+        for (int i = 0; i < NUM_PASSES; i++) {
+            result.cpu[i].reserve(scenario.frames);
+            result.gpu[i].reserve(scenario.frames);
+        }
+        for (int i = 0; i < NUM_COUNTERS; i++) {
+            result.counts[i].reserve(scenario.frames);
+        }
+
+        bool reported = false;
+        for (int i = 0; i < settings.warmup + scenario.frames; i++) {
+            scenario.update(i * settings.dt);
+            render_frame(window, planet, camera, sun, post, graph, i * settings.dt, settings.width, settings.height);
+            collect(result, first, last, collected);
+
+            // only the first measured frame that allocates is broken down, the rest are in the counter
+            if (settings.allocations && i >= settings.warmup && allocs.allocations > 0 && !reported) {
+                printf("%-14s frame %i made %i heap allocations (%zu bytes):\n", scenario.name.c_str(), i - settings.warmup, allocs.allocations, allocs.bytes);
+                for (int j = 0; j < allocs.num_sites; j++) {
+                    printf("    %-24s %6i %10zu bytes\n", allocs.sites[j].name, allocs.sites[j].count, allocs.sites[j].bytes);
+                }
+                reported = true;
+                allocating = true;
+            }
+        }
+
+        // run empty frames until the last measured frame has been read back
+        glFinish();
+        for (int i = 0; i < PROFILER_FRAMES; i++) {
+            profiler.begin_frame();
+            profiler.end_frame();
+            collect(result, first, last, collected);
+        }
+        for (int i = 0; i < NUM_MEMORY_TAGS; i++) {
+            result.peak_bytes[i] = MemoryTracker::get().peak((MemoryTag)i);
+        }
+        results.push_back(result);
+    }
+
+    // previous results to compare against, matched up by scenario name
+    JsonValue baseline;
+    bool has_baseline = !settings.baseline.empty() && load_json(settings.baseline, baseline);
+    bool regressed = false;
+
+    std::ofstream file(settings.out);
+    if (!file.is_open()) {
+        std::cout << "Failed to write " << settings.out << std::endl;
+        return 2;
+    }
+    const char *paths[] = {"fragment", "compute", "froxel"};
+    file << "{\n  \"renderer\": " << json_quote((const char *)glGetString(GL_RENDERER)) << ",\n";
+    file << "  \"width\": " << settings.width << ", \"height\": " << settings.height << ", \"dt\": " << settings.dt
+         << ", \"warmup\": " << settings.warmup << ", \"path\": \"" << paths[settings.path] << "\",\n";
+    file << "  \"scenarios\": [";
+    for (size_t s = 0; s < results.size(); s++) {
+        ScenarioResult &result = results[s];
+        file << (s ? "," : "") << "\n    {\"name\": " << json_quote(result.name) << ", \"frames\": " << result.frames
+             << ", \"dropped\": " << result.dropped << ",\n     \"passes\": {";
+        for (int i = 0; i < NUM_PASSES; i++) {
+            file << (i ? "," : "") << "\n       " << json_quote(PASSES[i]) << ": {\"cpu\": ";
+            write_summary(file, summarise(result.cpu[i]));
+            file << ", \"gpu\": ";
+            write_summary(file, summarise(result.gpu[i]));
+            file << "}";
+        }
+        file << "},\n     \"counters\": {";
+        for (int i = 0; i < NUM_COUNTERS; i++) {
+            file << (i ? ", " : "") << json_quote(COUNTERS[i]) << ": ";
+            write_summary(file, summarise(result.counts[i]));
+        }
+        file << "},\n     \"peak_mb\": {";
+        for (int i = 0; i < NUM_MEMORY_TAGS; i++) {
+            file << (i ? ", " : "") << json_quote(MEMORY_TAG_NAMES[i]) << ": " << result.peak_bytes[i] / 1048576.0;
+        }
+        file << "},\n     \"frame_cpu_histogram\": ";
+        write_histogram(file, result.cpu[0]);
+        file << ",\n     \"frame_gpu_histogram\": ";
+        write_histogram(file, result.gpu[0]);
+        file << "}";
+    }
+    file << "\n  ]";
+
+    if (has_baseline) {
+        // whole frame times are compared, a regression is a slowdown beyond the tolerance
+        const JsonValue *base_scenarios = baseline.get("scenarios");
+        file << ",\n  \"baseline\": " << json_quote(settings.baseline) << ", \"tolerance\": " << settings.tolerance << ",\n  \"comparison\": [";
+        bool first_entry = true;
+        for (ScenarioResult &result : results) {
+            const JsonValue *base = nullptr;
+            for (size_t i = 0; base_scenarios && i < base_scenarios->array.size(); i++) {
+                if (base_scenarios->array[i].get_string("name") == result.name) {
+                    base = &base_scenarios->array[i];
+                }
+            }
+            const JsonValue *passes = base ? base->get("passes") : nullptr;
+            const JsonValue *frame = passes ? passes->get("frame") : nullptr;
+            if (!frame) {
+                continue;
+            }
+
+            Summary cpu = summarise(result.cpu[0]), gpu = summarise(result.gpu[0]);
+            struct {
+                const char *metric, *side, *stat;
+                float current;
+            } metrics[] = {{"cpu p50", "cpu", "p50", cpu.p50}, {"gpu p50", "gpu", "p50", gpu.p50}, {"gpu p95", "gpu", "p95", gpu.p95}};
+            for (auto &metric : metrics) {
+                const JsonValue *side = frame->get(metric.side);
+                float before = side ? (float)side->get_number(metric.stat) : 0;
+                if (before <= 0) {
+                    continue;
+                }
+                float change = metric.current / before - 1;
+                bool worse = change > settings.tolerance;
+                regressed = regressed || worse;
+
+                file << (first_entry ? "" : ",") << "\n    {\"scenario\": " << json_quote(result.name) << ", \"metric\": \"frame " << metric.metric
+                     << "\", \"baseline\": " << before << ", \"current\": " << metric.current << ", \"change\": " << change
+                     << ", \"regressed\": " << (worse ? "true" : "false") << "}";
+                first_entry = false;
+
+                printf("%-14s frame %s: %8.2f ms -> %8.2f ms (%+.1f%%)%s\n", result.name.c_str(), metric.metric, before, metric.current, change * 100, worse ? "  REGRESSED" : "");
+            }
+        }
+        file << "\n  ]";
+    }
+    file << "\n}\n";
+    file.close();
+
+    for (ScenarioResult &result : results) {
+        Summary gpu = summarise(result.gpu[0]);
+        printf("%-14s %4i frames, gpu p50 %.2f ms, p95 %.2f ms, p99 %.2f ms\n", result.name.c_str(), result.frames, gpu.p50, gpu.p95, gpu.p99);
+    }
+    std::cout << "Wrote " << settings.out << std::endl;
+
+    glfwTerminate();
+    return regressed || allocating ? 1 : 0;
+}
@@ -0,0 +1,165 @@
+// cpu reference render of the default planet, needs no gpu or display
+//
+// usage: planet_reference [--width w] [--height h] [--samples n] [--step-scale s] [--threads n] [--time t]
+//                         [--camera x,y,z] [--target x,y,z] [--sun x,y,z] [--no-post]
+//                         [--out reference.png] [--compare golden.png] [--tolerance 0.02]
+//
+// with --compare, the render is checked against an image (a gpu capture, or an earlier reference) and
+// the tool exits with 1 if the rms error over the rgb channels is above the tolerance
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "reference_renderer.h"
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+struct ReferenceSettings {
+    int width = 800, height = 450;
+    int samples = 1;
+    float step_scale = 1;
+    int threads = 0;
+    float time = 0;
+    glm::vec3 camera = glm::vec3(0, 0, 10);
+    glm::vec3 target = glm::vec3(0, 0, 0);
+    glm::vec3 sun = glm::vec3(30, 0, 0);
+    bool postprocessing = true;
+    std::string out = "reference.png";
+    std::string compare;
+    float tolerance = 0.02f;
+};
+
+static bool parse_vec3(const char *s, glm::vec3 &v) {
+    return sscanf(s, "%f,%f,%f", &v.x, &v.y, &v.z) == 3;
+}
+
+static bool parse_args(int argc, char **argv, ReferenceSettings &settings) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--no-post") {
+            settings.postprocessing = false;
+        } else if (arg == "--width" && has_value) {
+            settings.width = atoi(argv[++i]);
+        } else if (arg == "--height" && has_value) {
+            settings.height = atoi(argv[++i]);
+        } else if (arg == "--samples" && has_value) {
+            settings.samples = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--step-scale" && has_value) {
+            settings.step_scale = (float)atof(argv[++i]);
+        } else if (arg == "--threads" && has_value) {
+            settings.threads = atoi(argv[++i]);
+        } else if (arg == "--time" && has_value) {
+            settings.time = (float)atof(argv[++i]);
+        } else if (arg == "--camera" && has_value) {
+            if (!parse_vec3(argv[++i], settings.camera)) {
+                std::cout << "Expected x,y,z after --camera" << std::endl;
+                return false;
+            }
+        } else if (arg == "--target" && has_value) {
+            if (!parse_vec3(argv[++i], settings.target)) {
+                std::cout << "Expected x,y,z after --target" << std::endl;
+                return false;
+            }
+        } else if (arg == "--sun" && has_value) {
+            if (!parse_vec3(argv[++i], settings.sun)) {
+                std::cout << "Expected x,y,z after --sun" << std::endl;
+                return false;
+            }
+        } else if (arg == "--out" && has_value) {
+            settings.out = argv[++i];
+        } else if (arg == "--compare" && has_value) {
+            settings.compare = argv[++i];
+        } else if (arg == "--tolerance" && has_value) {
+            settings.tolerance = (float)atof(argv[++i]);
+        } else {
+            std::cout << "Unknown argument " << arg << std::endl;
+            return false;
+        }
+    }
+    if (settings.width <= 0 || settings.height <= 0) {
+        std::cout << "Width and height have to be positive" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    ReferenceSettings settings;
+    if (!parse_args(argc, argv, settings)) {
+        return 2;
+    }
+
+    ReferenceRenderer renderer(settings.threads);
+    renderer.load_textures();
+    renderer.light.position = settings.sun;
+    renderer.postprocessing = settings.postprocessing;
+    renderer.samples = settings.samples;
+    renderer.step_scale = settings.step_scale;
+
+    Camera camera(settings.camera, glm::vec3(0, 1, 0), glm::vec3(0, 0, -1));
+    if (settings.target != settings.camera) {
+        camera.look_at(settings.camera, settings.target);
+    }
+
+    std::vector<glm::vec4> image;
+    renderer.render(camera, settings.time, settings.width, settings.height, image);
+    std::cout << "Rendered " << settings.width << "x" << settings.height << " at " << settings.samples
+              << " spp in " << renderer.render_ms << " ms" << std::endl;
+
+    // the image is bottom row first, png is top row first
+    std::vector<unsigned char> pixels;
+    ReferenceRenderer::to_rgba8(image, pixels);
+    int stride = settings.width * 4;
+    std::vector<unsigned char> flipped(pixels.size());
+    for (int y = 0; y < settings.height; y++) {
+        std::copy(pixels.begin() + (size_t)y * stride, pixels.begin() + (size_t)(y + 1) * stride,
+                  flipped.begin() + (size_t)(settings.height - 1 - y) * stride);
+    }
+    if (!stbi_write_png(settings.out.c_str(), settings.width, settings.height, 4, flipped.data(), stride)) {
+        std::cout << "Failed to write " << settings.out << std::endl;
+        return 2;
+    }
+    std::cout << "Wrote " << settings.out << std::endl;
+
+    if (settings.compare.empty()) {
+        return 0;
+    }
+
+    int w, h, c;
+    unsigned char *golden = stbi_load(settings.compare.c_str(), &w, &h, &c, 4);
+    if (!golden) {
+        std::cout << "Failed to load " << settings.compare << std::endl;
+        return 2;
+    }
+    if (w != settings.width || h != settings.height) {
+        std::cout << settings.compare << " is " << w << "x" << h << ", not " << settings.width << "x" << settings.height << std::endl;
+        stbi_image_free(golden);
+        return 2;
+    }
+
+    double sum = 0;
+    int max_diff = 0;
+    for (size_t i = 0; i < flipped.size(); i++) {
+        if (i % 4 == 3) {
+            continue;
+        }
+        int diff = std::abs((int)flipped[i] - (int)golden[i]);
+        sum += (diff / 255.0) * (diff / 255.0);
+        max_diff = std::max(max_diff, diff);
+    }
+    stbi_image_free(golden);
+
+    float rmse = (float)std::sqrt(sum / (flipped.size() / 4 * 3));
+    bool passed = rmse <= settings.tolerance;
+    std::cout << "RMS error " << rmse << " (max " << max_diff << "/255) against " << settings.compare
+              << (passed ? ", passed" : ", FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,49 @@
+// offline converter for the normal maps, writes the compressed .ktx the app loads in place of the image
+//
+// usage: planet_texture <image> [<image> ...] [--out file.ktx]
+//
+// each image is written next to itself with a .ktx extension, or to --out when there is a single one
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "stb_image.h"
+#include "texture_file.h"
+
+int main(int argc, char **argv) {
+    std::vector<std::string> images;
+    std::string out;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc) {
+            out = argv[++i];
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cout << "Unknown argument " << arg << std::endl;
+            return 1;
+        } else {
+            images.push_back(arg);
+        }
+    }
+    if (images.empty() || (!out.empty() && images.size() > 1)) {
+        std::cout << "usage: planet_texture <image> [<image> ...] [--out file.ktx]" << std::endl;
+        return 1;
+    }
+
+    for (const std::string &image : images) {
+        int w, h, c;
+        unsigned char *pixels = stbi_load(image.c_str(), &w, &h, &c, 3);
+        if (!pixels) {
+            std::cout << "Failed to load " << image << std::endl;
+            return 1;
+        }
+        std::string path = out.empty() ? compressed_texture_path(image) : out;
+        bool ok = write_normal_map(path, pixels, w, h, 3);
+        stbi_image_free(pixels);
+        if (!ok) {
+            return 1;
+        }
+        std::cout << "Wrote " << path << " (" << w << "x" << h << ")" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,354 @@
+#include "virtual_terrain.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+
+#include "gl_state.h"
+#include "terrain_noise.h"
+
+// same layout as bake.comp and gl cubemaps
+int cube_face_uv(const glm::vec3 &dir, glm::vec2 &uv) {
+    glm::vec3 a = glm::abs(dir);
+    int face;
+    float major, s, t;
+    if (a.x >= a.y && a.x >= a.z) {
+        face = dir.x > 0 ? 0 : 1;
+        major = a.x;
+        s = dir.x > 0 ? -dir.z : dir.z;
+        t = -dir.y;
+    } else if (a.y >= a.z) {
+        face = dir.y > 0 ? 2 : 3;
+        major = a.y;
+        s = dir.x;
+        t = dir.y > 0 ? dir.z : -dir.z;
+    } else {
+        face = dir.z > 0 ? 4 : 5;
+        major = a.z;
+        s = dir.z > 0 ? dir.x : -dir.x;
+        t = -dir.y;
+    }
+    uv = (glm::vec2(s, t) / major + 1.0f) * 0.5f;
+    return face;
+}
+
+glm::vec3 cube_face_direction(int face, glm::vec2 uv) {
+    glm::vec2 st = uv * 2.0f - 1.0f;
+    switch (face) {
+        case 0: return glm::vec3(1.0f, -st.y, -st.x);
+        case 1: return glm::vec3(-1.0f, -st.y, st.x);
+        case 2: return glm::vec3(st.x, 1.0f, st.y);
+        case 3: return glm::vec3(st.x, -1.0f, -st.y);
+        case 4: return glm::vec3(st.x, -st.y, 1.0f);
+        default: return glm::vec3(-st.x, -st.y, -1.0f);
+    }
+}
+
+VirtualTerrain::~VirtualTerrain() {
+    // the generator's tasks point back at us, so it has to finish first
+    generator.reset();
+}
+
+void VirtualTerrain::update(const PlanetParams &params, float radius, const glm::vec3 &planet_pos, float planet_scale, Camera &camera, int viewport_height) {
+    if (!atlas) {
+        create_resources();
+    }
+    frame++;
+    ArtifactCache &cache = ArtifactCache::get();
+
+    // any change to the terrain makes every tile stale, the old roots stay so every lookup has something to
+    // fall back on while the new ones are generated like any other tile (dragging a slider never stalls on them)
+    CacheKey terrain("terrain tiles");
+    terrain.add(radius).add(params.noise_mult).add(params.offset).add(params.octaves).add(params.noise_params).add(params.ocean_params);
+    if (terrain.hash != params_hash) {
+        params_hash = terrain.hash;
+        current_hash = terrain.hash;
+        for (Slot &slot : slots) {
+            if (slot.filled && (slot.key >> 35) == 0) { // level 0, above the face bits of the high word
+                stale.insert(slot.key);
+            } else if (slot.filled) {
+                slot_of.erase(slot.key);
+                slot = Slot();
+            }
+        }
+        resident = (int)slot_of.size();
+        requested.clear();
+        table_dirty = true;
+        {
+            std::lock_guard<std::mutex> lock(ready_mutex);
+            ready.clear();
+        }
+    }
+
+    // tiles the camera wants, coarsest first, in the planet's own space
+    float focal = viewport_height / (2.0f * tanf(glm::radians(camera.get_zoom()) * 0.5f));
+    glm::vec3 camera_pos = (camera.get_position() - planet_pos) / planet_scale;
+    std::vector<TileId> tiles;
+    select_tiles(radius, camera_pos, focal, tiles);
+    wanted = (int)tiles.size();
+
+    // everything wanted and resident is in use this frame before anything is uploaded, so an upload never
+    // evicts a tile that is still on screen
+    for (const TileId &tile : tiles) {
+        auto slot = slot_of.find(tile.key());
+        if (slot != slot_of.end()) {
+            slots[slot->second].last_used = frame;
+        }
+    }
+
+    // finished tiles from the generator, for this terrain only
+    std::vector<Ready> finished;
+    {
+        std::lock_guard<std::mutex> lock(ready_mutex);
+        finished.swap(ready);
+    }
+    int uploaded_this_frame = 0;
+    for (Ready &tile : finished) {
+        if (tile.params_hash != params_hash) {
+            continue;
+        }
+        requested.erase(tile.key);
+        if ((!slot_of.count(tile.key) || stale.count(tile.key)) && upload(tile.key, *tile.tile)) {
+            uploaded_this_frame++;
+        }
+    }
+
+    for (const TileId &tile : tiles) {
+        uint64_t key = tile.key();
+        if ((slot_of.count(key) && !stale.count(key)) || requested.count(key)) {
+            continue;
+        }
+
+        // already on disk, mapped and uploaded within this frame's budget
+        if (uploaded_this_frame >= uploads_per_frame) {
+            continue;
+        }
+        std::shared_ptr<const Artifact> cached = cache.find(tile_key(params_hash, key));
+        if (cached) {
+            uploaded_this_frame += upload(key, *cached) ? 1 : 0;
+            continue;
+        }
+
+        // otherwise made in the background, with a bounded queue so a fast camera never piles up work
+        if (generator->get_pending() >= 4 * generator->size()) {
+            continue;
+        }
+        requested.insert(key);
+        uint64_t hash = params_hash;
+        generator->submit([this, tile, key, hash, params, radius] {
+            if (current_hash != hash) {
+                return;
+            }
+            std::vector<uint16_t> texels = generate(tile, params, radius);
+            std::shared_ptr<const Artifact> artifact = ArtifactCache::get().store(tile_key(hash, key), {{texels.data(), texels.size() * sizeof(uint16_t)}});
+            std::lock_guard<std::mutex> lock(ready_mutex);
+            ready.push_back({key, hash, artifact});
+            generated++;
+        });
+    }
+    generating = generator->get_pending();
+
+    if (table_dirty) {
+        write_page_table();
+    }
+}
+
+void VirtualTerrain::bind(Shader &shader, int texture_unit, int segments) {
+    GlState::get().bind_texture(texture_unit, GL_TEXTURE_2D, atlas);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VT_PAGE_TABLE_BINDING, page_table);
+    shader.set_int("vt_max_level", max_level);
+    // vertices read the level whose texels are as far apart as the vertices
+    shader.set_int("vt_vertex_level", std::max(0, std::min(max_level, (int)std::log2(std::max(1, segments / VT_TILE_SIZE)))));
+}
+
+void VirtualTerrain::release() {
+    generator.reset();
+    atlas.reset();
+    page_table.reset();
+    atlas_bytes.set(0);
+    page_table_bytes.set(0);
+    for (Slot &slot : slots) {
+        slot = Slot();
+    }
+    slot_of.clear();
+    requested.clear();
+    stale.clear();
+    ready.clear();
+    params_hash = 0;
+    current_hash = 0;
+    wanted = resident = generating = 0;
+}
+
+size_t VirtualTerrain::gpu_bytes() {
+    if (!atlas) {
+        return 0;
+    }
+    return (size_t)VT_SLOTS * VT_TILE_STRIDE * VT_TILE_STRIDE * 4 * sizeof(uint16_t) + VT_PAGE_TABLE_SIZE * sizeof(glm::uvec4);
+}
+
+void VirtualTerrain::create_resources() {
+    int size = VT_ATLAS_TILES * VT_TILE_STRIDE;
+    atlas = GlTexture::generate();
+    GlState::get().bind_texture(GL_TEXTURE_2D, atlas);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, size, size);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    GlState::get().bind_texture(GL_TEXTURE_2D, 0);
+
+    page_table = GlBuffer::generate();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, page_table);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, VT_PAGE_TABLE_SIZE * sizeof(glm::uvec4), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    atlas_bytes.set((size_t)size * size * 4 * sizeof(uint16_t));
+    page_table_bytes.set(VT_PAGE_TABLE_SIZE * sizeof(glm::uvec4));
+    table_dirty = true;
+
+    generator = std::make_unique<ThreadPool>(2);
+}
+
+// walk the quadtree of every face, splitting a tile while its texels cover more than a pixel and any of it can
+// be above the horizon, until every slot of the atlas has a tile
+void VirtualTerrain::select_tiles(float radius, const glm::vec3 &camera_pos, float focal, std::vector<TileId> &tiles) {
+    std::deque<TileId> queue;
+    for (int face = 0; face < 6; face++) {
+        queue.push_back({face, 0, 0, 0});
+    }
+
+    float camera_dist = glm::length(camera_pos);
+    while (!queue.empty()) {
+        TileId tile = queue.front();
+        queue.pop_front();
+        tiles.push_back(tile);
+        if (tile.level >= max_level || (int)(tiles.size() + queue.size()) + 4 > VT_SLOTS) {
+            continue;
+        }
+
+        float count = (float)(1 << tile.level);
+        glm::vec3 centre = glm::normalize(cube_face_direction(tile.face, (glm::vec2(tile.x, tile.y) + 0.5f) / count)) * radius;
+        float edge = 2.0f * radius / sqrtf(3.0f) / count;
+        float distance = std::max(glm::length(camera_pos - centre) - edge, 1e-6f);
+        if (edge / VT_TILE_SIZE / distance * focal <= 1.0f) {
+            continue;
+        }
+
+        for (int i = 0; i < 4; i++) {
+            TileId child = {tile.face, tile.level + 1, tile.x * 2 + (i & 1), tile.y * 2 + (i >> 1)};
+            // a point of the sphere is visible while it is in front of the horizon plane, less the tile's size
+            // to leave room for the terrain and for the rest of the tile
+            float child_count = count * 2;
+            bool visible = camera_dist <= radius;
+            for (int c = 0; c < 5 && !visible; c++) {
+                glm::vec2 corner = c < 4 ? glm::vec2(c & 1, c >> 1) : glm::vec2(0.5f);
+                glm::vec3 dir = glm::normalize(cube_face_direction(child.face, (glm::vec2(child.x, child.y) + corner) / child_count));
+                visible = glm::dot(dir, camera_pos) > radius - edge;
+            }
+            if (visible) {
+                queue.push_back(child);
+            }
+        }
+    }
+}
+
+CacheKey VirtualTerrain::tile_key(uint64_t params_hash, uint64_t key) {
+    CacheKey tile("terrain tile");
+    tile.add(params_hash).add(key);
+    return tile;
+}
+
+// what bake.comp stores per texel (normal and raw noise height, as half floats), for one tile and its border
+std::vector<uint16_t> VirtualTerrain::generate(const TileId &tile, const PlanetParams &params, float radius) {
+    float count = (float)(1 << tile.level);
+    float cube_half = radius / sqrtf(3.0f);
+    // the normal is taken over a texel at most, so deep tiles get normals as fine as their texels
+    float delta = std::min(params.noise_params.w, 2.0f * cube_half / (count * VT_TILE_SIZE));
+    int extra_octaves = std::max(0, tile.level - VT_DETAIL_LEVEL);
+
+    std::vector<uint16_t> texels(VT_TILE_STRIDE * VT_TILE_STRIDE * 4);
+    for (int j = 0; j < VT_TILE_STRIDE; j++) {
+        for (int i = 0; i < VT_TILE_STRIDE; i++) {
+            glm::vec2 uv = (glm::vec2(tile.x, tile.y) + (glm::vec2(i, j) - (float)VT_TILE_BORDER + 0.5f) / (float)VT_TILE_SIZE) / count;
+            glm::vec3 pos = cube_face_direction(tile.face, uv) * cube_half;
+            float local_ht;
+            glm::vec3 displaced = terrain_point(params, radius, pos, local_ht, extra_octaves);
+            glm::vec3 normal = terrain_normal(params, radius, pos, displaced, delta, extra_octaves);
+            uint16_t *texel = &texels[(j * VT_TILE_STRIDE + i) * 4];
+            texel[0] = glm::packHalf1x16(normal.x);
+            texel[1] = glm::packHalf1x16(normal.y);
+            texel[2] = glm::packHalf1x16(normal.z);
+            texel[3] = glm::packHalf1x16(local_ht);
+        }
+    }
+    return texels;
+}
+
+// copy a tile over the stale one it replaces, into a free slot, or the slot used longest ago if none is free,
+// never one wanted this frame
+bool VirtualTerrain::upload(uint64_t key, const Artifact &tile) {
+    if (tile.size() != (size_t)VT_TILE_STRIDE * VT_TILE_STRIDE * 4 * sizeof(uint16_t)) {
+        return false;
+    }
+    int best = -1;
+    auto replaced = slot_of.find(key);
+    if (replaced != slot_of.end()) {
+        best = replaced->second;
+        stale.erase(key);
+    } else {
+        for (int i = 0; i < VT_SLOTS; i++) {
+            if (!slots[i].filled) {
+                best = i;
+                break;
+            }
+            if (slots[i].last_used < frame && (best < 0 || slots[i].last_used < slots[best].last_used)) {
+                best = i;
+            }
+        }
+    }
+    if (best < 0) {
+        return false;
+    }
+
+    Slot &slot = slots[best];
+    if (slot.filled) {
+        slot_of.erase(slot.key);
+    }
+    slot.key = key;
+    slot.filled = true;
+    slot.last_used = frame;
+    slot_of[key] = best;
+    table_dirty = true;
+    resident = (int)slot_of.size();
+    uploads++;
+
+    GlState::get().bind_texture(GL_TEXTURE_2D, atlas);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (best % VT_ATLAS_TILES) * VT_TILE_STRIDE, (best / VT_ATLAS_TILES) * VT_TILE_STRIDE, VT_TILE_STRIDE, VT_TILE_STRIDE,
+                    GL_RGBA, GL_HALF_FLOAT, tile.data());
+    GlState::get().bind_texture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+// open addressing with linear probing, hashed the same way as vt_find in virtual_terrain.glsl
+void VirtualTerrain::write_page_table() {
+    std::vector<glm::uvec4> table(VT_PAGE_TABLE_SIZE, glm::uvec4(0, 0xffffffffu, 0, 0));
+    for (const auto &entry : slot_of) {
+        uint32_t lo = (uint32_t)entry.first, hi = (uint32_t)(entry.first >> 32);
+        uint32_t h = (lo * 0x9e3779b1u) ^ (hi * 0x85ebca77u);
+        h ^= h >> 15;
+        for (uint32_t i = 0; i < (uint32_t)VT_PAGE_TABLE_SIZE; i++) {
+            glm::uvec4 &page = table[(h + i) & (VT_PAGE_TABLE_SIZE - 1)];
+            if (page.y == 0xffffffffu) {
+                page = glm::uvec4(lo, hi, (uint32_t)entry.second, 0);
+                break;
+            }
+        }
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, page_table);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, table.size() * sizeof(glm::uvec4), table.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    table_dirty = false;
+}